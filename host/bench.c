@@ -0,0 +1,129 @@
+// SPDX-License-Identifier: GPL-2.0-only
+// Copyright (C) 2022, Input Labs Oy.
+
+// Host benchmark.
+// Runs the real main loop against the shim on a virtual clock, feeding a
+// deterministic input pattern, and reports the host time spent per tick for
+// each profile. The USB report hash is stable across runs, so it doubles as
+// a regression signature for the mapping logic.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include <pico/stdlib.h>
+#include "config.h"
+#include "bus.h"
+#include "hid.h"
+#include "led.h"
+#include "imu.h"
+#include "touch.h"
+#include "profile.h"
+#include "rotary.h"
+#include "rumble.h"
+#include "thumbstick.h"
+#include "tick.h"
+#include "event.h"
+#include "calibration.h"
+
+#define BENCH_TICKS_DEFAULT 100000
+
+static const char *profile_names[] = {
+    "home",
+    "fps_fusion",
+    "racing",
+    "console",
+    "desktop",
+    "fps_wasd",
+    "flight",
+    "console_legacy",
+    "rts",
+};
+
+uint64_t bench_now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Input pattern, presses one expander button at a time for 50 ticks, and
+// sweeps the thumbstick and gyro through their ranges. The home button is
+// never pressed, so the profile under test stays active.
+void bench_inputs(uint32_t tick) {
+    uint32_t step = tick / 50;
+    uint16_t io_0 = ~(1 << (step % 16));
+    uint16_t io_1 = ~(1 << ((step / 3) % 16));
+    shim_io_set(0, io_0);
+    shim_io_set(1, io_1);
+    double angle = tick * 0.01;
+    double radius = (tick / 500) % 2 ? 1.0 : 0.3;
+    shim_adc_set(0, 2048 + 2000 * radius * cos(angle));
+    shim_adc_set(1, 2048 + 2000 * radius * sin(angle));
+    shim_gyro_set(
+        (int16_t)(4000 * sin(angle * 0.7)),
+        (int16_t)(4000 * cos(angle * 0.3)),
+        (int16_t)(1000 * sin(angle * 0.1))
+    );
+}
+
+// TinyUSB callback from tusb_config.c, which is not part of the host build.
+void tud_hid_report_complete_cb(uint8_t instance, uint8_t const *report, uint8_t len) {
+    hid_report_drain();
+}
+
+void bench_init() {
+    config_init();
+    bus_init();
+    hid_init();
+    event_init();
+    led_init();
+    thumbstick_init();
+    touch_init();
+    rotary_init();
+    rumble_init();
+    profile_init();
+    imu_init();
+    tusb_init();
+    tick_init();
+}
+
+// Every profile starts from a clean state, so its signature does not depend
+// on what the previous profile left pressed or scheduled.
+void bench_profile(uint8_t index, uint32_t ticks) {
+    event_cancel_all();
+    hid_matrix_reset();
+    profile_reset_all();
+    profile_set_active(index);
+    *shim_usb_get_stats() = (shim_usb_stats_t){0,};
+    tick_reset_stats();
+    uint64_t start = bench_now_ns();
+    for(uint32_t i=0; i<ticks; i++) {
+        bench_inputs(i);
+        tick_wait();
+        event_run();
+        profile_report_active();
+        hid_report();
+        calibration_run();
+        tick_completed();
+    }
+    uint64_t elapsed = bench_now_ns() - start;
+    shim_usb_stats_t *stats = shim_usb_get_stats();
+    printf(
+        "BENCH: %-15s ticks=%u ns/tick=%.1f reports=%u xfers=%u hash=%08x\n",
+        profile_names[index],
+        ticks,
+        (double)elapsed / ticks,
+        stats->reports,
+        stats->xfers,
+        stats->hash
+    );
+}
+
+int main(int argc, char **argv) {
+    uint32_t ticks = argc > 1 ? atoi(argv[1]) : BENCH_TICKS_DEFAULT;
+    bench_init();
+    for(uint8_t i=0; i<sizeof(profile_names)/sizeof(profile_names[0]); i++) {
+        bench_profile(i, ticks);
+    }
+    return 0;
+}
@@ -0,0 +1,5 @@
+// SPDX-License-Identifier: GPL-2.0-only
+// Copyright (C) 2022, Input Labs Oy.
+
+#pragma once
+#include "shim.h"
@@ -0,0 +1,275 @@
+// SPDX-License-Identifier: GPL-2.0-only
+// Copyright (C) 2022, Input Labs Oy.
+
+// Minimal stand-in for the subset of the Pico SDK and TinyUSB used by the
+// firmware, so the sources can be compiled and exercised on the host.
+// Time is virtual: it advances through the sleep functions, busy loops,
+// waiting for events (which jumps to the next alarm) or shim_clock_advance(),
+// and any due alarm fires as it passes.
+
+#pragma once
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+typedef unsigned int uint;
+
+// Time.
+typedef uint64_t absolute_time_t;
+typedef int32_t alarm_id_t;
+typedef int64_t (*alarm_callback_t)(alarm_id_t id, void *user_data);
+typedef struct alarm_pool alarm_pool_t;
+typedef struct repeating_timer repeating_timer_t;
+typedef bool (*repeating_timer_callback_t)(repeating_timer_t *rt);
+struct repeating_timer {
+    int64_t delay_us;
+    repeating_timer_callback_t callback;
+    void *user_data;
+    alarm_id_t alarm_id;
+};
+
+uint32_t time_us_32();
+uint64_t time_us_64();
+absolute_time_t get_absolute_time();
+uint32_t to_ms_since_boot(absolute_time_t t);
+uint64_t to_us_since_boot(absolute_time_t t);
+absolute_time_t from_us_since_boot(uint64_t us);
+void sleep_us(uint64_t us);
+void sleep_ms(uint32_t ms);
+alarm_id_t add_alarm_in_ms(uint32_t ms, alarm_callback_t callback, void *user_data, bool fire_if_past);
+alarm_id_t add_alarm_in_us(uint64_t us, alarm_callback_t callback, void *user_data, bool fire_if_past);
+bool cancel_alarm(alarm_id_t alarm);
+alarm_pool_t *alarm_pool_create(uint hardware_alarm_num, uint max_timers);
+alarm_id_t alarm_pool_add_alarm_in_ms(alarm_pool_t *pool, uint32_t ms, alarm_callback_t callback, void *user_data, bool fire_if_past);
+bool alarm_pool_cancel_alarm(alarm_pool_t *pool, alarm_id_t alarm);
+bool add_repeating_timer_ms(int32_t ms, repeating_timer_callback_t callback, void *user_data, repeating_timer_t *out);
+bool cancel_repeating_timer(repeating_timer_t *timer);
+typedef void (*hardware_alarm_callback_t)(uint alarm_num);
+int hardware_alarm_claim_unused(bool required);
+void hardware_alarm_set_callback(uint alarm_num, hardware_alarm_callback_t callback);
+bool hardware_alarm_set_target(uint alarm_num, absolute_time_t t);
+
+// Stdio.
+void stdio_init_all();
+void stdio_uart_init();
+int getchar_timeout_us(uint32_t timeout_us);
+
+// Misc system.
+#define XIP_BASE 0
+void reset_usb_boot(uint32_t gpio_mask, uint32_t interface_disable_mask);
+void watchdog_enable(uint32_t delay_ms, bool pause_on_debug);
+void pico_get_unique_board_id_string(char *id_out, uint len);
+uint32_t save_and_disable_interrupts();
+void restore_interrupts(uint32_t status);
+void multicore_launch_core1(void (*entry)(void));
+void __wfi();
+void __wfe();
+void __sev();
+void __dmb();
+void tight_loop_contents();
+
+// GPIO.
+#define GPIO_IN false
+#define GPIO_OUT true
+#define GPIO_FUNC_I2C 3
+#define GPIO_FUNC_SPI 1
+#define GPIO_FUNC_PWM 4
+#define GPIO_IRQ_EDGE_FALL 0x4u
+#define GPIO_IRQ_EDGE_RISE 0x8u
+typedef void (*gpio_irq_callback_t)(uint gpio, uint32_t events);
+void gpio_init(uint gpio);
+void gpio_set_dir(uint gpio, bool out);
+void gpio_pull_up(uint gpio);
+void gpio_set_pulls(uint gpio, bool up, bool down);
+void gpio_set_function(uint gpio, uint fn);
+bool gpio_get(uint gpio);
+void gpio_put(uint gpio, bool value);
+void gpio_set_irq_enabled(uint gpio, uint32_t events, bool enabled);
+void gpio_set_irq_enabled_with_callback(uint gpio, uint32_t events, bool enabled, gpio_irq_callback_t callback);
+
+// ADC.
+void adc_init();
+void adc_gpio_init(uint gpio);
+void adc_select_input(uint input);
+uint16_t adc_read();
+
+// ADC free-running mode and DMA, only ADC to memory transfers are emulated,
+// producing samples in round-robin as the virtual clock advances.
+typedef struct {
+    volatile uint32_t fifo;
+} adc_hw_t;
+extern adc_hw_t *adc_hw;
+void adc_fifo_setup(bool en, bool dreq_en, uint16_t dreq_thresh, bool err_in_fifo, bool byte_shift);
+void adc_set_round_robin(uint input_mask);
+void adc_set_clkdiv(float clkdiv);
+void adc_run(bool run);
+void adc_fifo_drain();
+#define DREQ_ADC 36
+enum dma_channel_transfer_size {DMA_SIZE_8, DMA_SIZE_16, DMA_SIZE_32};
+typedef struct {
+    bool write_increment;
+    bool ring_write;
+    uint ring_bits;
+    uint dreq;
+} dma_channel_config;
+typedef struct {
+    volatile uint32_t transfer_count;
+} dma_channel_hw_t;
+int dma_claim_unused_channel(bool required);
+dma_channel_config dma_channel_get_default_config(uint channel);
+void channel_config_set_transfer_data_size(dma_channel_config *c, enum dma_channel_transfer_size size);
+void channel_config_set_read_increment(dma_channel_config *c, bool incr);
+void channel_config_set_write_increment(dma_channel_config *c, bool incr);
+void channel_config_set_ring(dma_channel_config *c, bool write, uint size_bits);
+void channel_config_set_dreq(dma_channel_config *c, uint dreq);
+void dma_channel_configure(uint channel, const dma_channel_config *config, volatile void *write_addr, const volatile void *read_addr, uint transfer_count, bool trigger);
+dma_channel_hw_t *dma_channel_hw_addr(uint channel);
+bool dma_channel_is_busy(uint channel);
+void dma_channel_set_trans_count(uint channel, uint32_t trans_count, bool trigger);
+void dma_channel_set_write_addr(uint channel, volatile void *write_addr, bool trigger);
+
+// I2C and SPI.
+typedef struct i2c_inst i2c_inst_t;
+typedef struct spi_inst spi_inst_t;
+extern i2c_inst_t *i2c1;
+extern spi_inst_t *spi1;
+uint i2c_init(i2c_inst_t *i2c, uint baudrate);
+int i2c_write_blocking(i2c_inst_t *i2c, uint8_t addr, const uint8_t *src, size_t len, bool nostop);
+int i2c_read_blocking(i2c_inst_t *i2c, uint8_t addr, uint8_t *dst, size_t len, bool nostop);
+uint spi_init(spi_inst_t *spi, uint baudrate);
+int spi_write_blocking(spi_inst_t *spi, const uint8_t *src, size_t len);
+int spi_read_blocking(spi_inst_t *spi, uint8_t repeated_tx_data, uint8_t *dst, size_t len);
+
+// PWM.
+uint pwm_gpio_to_slice_num(uint gpio);
+void pwm_set_wrap(uint slice_num, uint16_t wrap);
+void pwm_set_enabled(uint slice_num, bool enabled);
+void pwm_set_gpio_level(uint gpio, uint16_t level);
+
+// USB controller registers, SOF_RD follows the virtual clock (1 ms frames).
+typedef struct {
+    volatile uint32_t sof_rd;
+} usb_hw_t;
+extern usb_hw_t *usb_hw;
+
+// SysTick, CVR counts down at 125MHz of virtual time.
+#define M0PLUS_SYST_CSR_CLKSOURCE_BITS 0x4
+#define M0PLUS_SYST_CSR_ENABLE_BITS 0x1
+typedef struct {
+    volatile uint32_t csr;
+    volatile uint32_t rvr;
+    volatile uint32_t cvr;
+    volatile uint32_t calib;
+} systick_hw_t;
+extern systick_hw_t *systick_hw;
+
+// Clocks.
+enum clock_index {clk_sys = 5};
+uint32_t clock_get_hz(enum clock_index clk_index);
+
+// Flash.
+void flash_range_erase(uint32_t flash_offs, size_t count);
+void flash_range_program(uint32_t flash_offs, const uint8_t *data, size_t count);
+
+// TinyUSB.
+#define TU_ATTR_PACKED __attribute__ ((packed))
+#define CONTROL_STAGE_SETUP 1
+#define TUSB_DESC_STRING 0x03
+typedef enum {
+    XFER_RESULT_SUCCESS,
+    XFER_RESULT_FAILED,
+    XFER_RESULT_STALLED,
+} xfer_result_t;
+typedef enum {
+    HID_REPORT_TYPE_INVALID,
+    HID_REPORT_TYPE_INPUT,
+    HID_REPORT_TYPE_OUTPUT,
+    HID_REPORT_TYPE_FEATURE,
+} hid_report_type_t;
+typedef struct TU_ATTR_PACKED {
+    uint8_t bLength;
+    uint8_t bDescriptorType;
+    uint8_t bInterfaceNumber;
+    uint8_t bAlternateSetting;
+    uint8_t bNumEndpoints;
+    uint8_t bInterfaceClass;
+    uint8_t bInterfaceSubClass;
+    uint8_t bInterfaceProtocol;
+    uint8_t iInterface;
+} tusb_desc_interface_t;
+typedef struct TU_ATTR_PACKED {
+    uint8_t bLength;
+    uint8_t bDescriptorType;
+    uint8_t bEndpointAddress;
+    uint8_t bmAttributes;
+    uint16_t wMaxPacketSize;
+    uint8_t bInterval;
+} tusb_desc_endpoint_t;
+typedef struct TU_ATTR_PACKED {
+    uint8_t bmRequestType;
+    uint8_t bRequest;
+    uint16_t wValue;
+    uint16_t wIndex;
+    uint16_t wLength;
+} tusb_control_request_t;
+typedef struct {
+    void (*init) (void);
+    void (*reset) (uint8_t rhport);
+    uint16_t (*open) (uint8_t rhport, tusb_desc_interface_t const *desc_intf, uint16_t max_len);
+    bool (*control_xfer_cb) (uint8_t rhport, uint8_t stage, tusb_control_request_t const *request);
+    bool (*xfer_cb) (uint8_t rhport, uint8_t ep_addr, xfer_result_t result, uint32_t xferred_bytes);
+    void (*sof) (uint8_t rhport);
+} usbd_class_driver_t;
+typedef struct TU_ATTR_PACKED {
+    int8_t x;
+    int8_t y;
+    int8_t z;
+    int8_t rz;
+    int8_t rx;
+    int8_t ry;
+    uint8_t hat;
+    uint32_t buttons;
+} hid_gamepad_report_t;
+bool tusb_init();
+void tud_task();
+bool tud_ready();
+bool tud_suspended();
+bool tud_remote_wakeup();
+#define HID_PROTOCOL_BOOT 0
+#define HID_PROTOCOL_REPORT 1
+bool tud_hid_n_ready(uint8_t instance);
+bool tud_hid_ready();
+uint8_t tud_hid_n_get_protocol(uint8_t instance);
+uint8_t tud_hid_get_protocol();
+bool tud_hid_n_report(uint8_t instance, uint8_t report_id, void const *report, uint8_t len);
+bool tud_hid_report(uint8_t report_id, void const *report, uint8_t len);
+bool tud_hid_n_keyboard_report(uint8_t instance, uint8_t report_id, uint8_t modifier, uint8_t keycode[6]);
+bool tud_hid_keyboard_report(uint8_t report_id, uint8_t modifier, uint8_t keycode[6]);
+bool tud_hid_n_mouse_report(uint8_t instance, uint8_t report_id, uint8_t buttons, int8_t x, int8_t y, int8_t vertical, int8_t horizontal);
+bool tud_hid_mouse_report(uint8_t report_id, uint8_t buttons, int8_t x, int8_t y, int8_t vertical, int8_t horizontal);
+void tud_hid_report_complete_cb(uint8_t instance, uint8_t const *report, uint8_t len);
+bool tud_control_xfer(uint8_t rhport, tusb_control_request_t const *request, void *buffer, uint16_t len);
+bool usbd_edpt_open(uint8_t rhport, tusb_desc_endpoint_t const *desc_ep);
+bool usbd_edpt_busy(uint8_t rhport, uint8_t ep_addr);
+bool usbd_edpt_claim(uint8_t rhport, uint8_t ep_addr);
+bool usbd_edpt_release(uint8_t rhport, uint8_t ep_addr);
+bool usbd_edpt_xfer(uint8_t rhport, uint8_t ep_addr, uint8_t *buffer, uint16_t total_bytes);
+usbd_class_driver_t const *usbd_app_driver_get_cb(uint8_t *driver_count);
+
+// Host-side controls, not part of the SDK.
+typedef struct {
+    uint32_t reports;
+    uint32_t report_bytes;
+    uint32_t xfers;
+    uint32_t xfer_bytes;
+    uint32_t hash;  // FNV-1a over every report and IN transfer.
+} shim_usb_stats_t;
+void shim_clock_advance(uint64_t us);
+void shim_gpio_set_input(uint gpio, bool value);
+void shim_adc_set(uint input, uint16_t value);
+void shim_io_set(uint8_t device, uint16_t value);
+void shim_gyro_set(int16_t x, int16_t y, int16_t z);
+shim_usb_stats_t *shim_usb_get_stats();
+void shim_hid_set_protocol(uint8_t protocol);
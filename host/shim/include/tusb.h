@@ -0,0 +1,6 @@
+// SPDX-License-Identifier: GPL-2.0-only
+// Copyright (C) 2022, Input Labs Oy.
+
+#pragma once
+#include "shim.h"
+#include "tusb_config.h"
@@ -0,0 +1,718 @@
+// SPDX-License-Identifier: GPL-2.0-only
+// Copyright (C) 2022, Input Labs Oy.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "shim.h"
+#include "nvm.h"
+
+#define SHIM_ALARMS 256
+#define SHIM_GPIOS 30
+#define SHIM_FLASH_SIZE (2 * 1024 * 1024)
+
+typedef struct {
+    bool active;
+    uint64_t due;
+    alarm_callback_t callback;
+    void *user_data;
+} shim_alarm_t;
+
+static uint64_t clock_us = 0;
+static shim_alarm_t alarms[SHIM_ALARMS];
+static hardware_alarm_callback_t hardware_alarm_callbacks[4];
+static uint64_t hardware_alarm_targets[4];
+static bool hardware_alarm_armed[4];
+static bool gpio_inputs[SHIM_GPIOS];
+static gpio_irq_callback_t gpio_callback = NULL;
+static uint16_t adc_values[4] = {2048, 2048, 2048, 2048};
+static uint adc_input = 0;
+static uint16_t io_values[2] = {0, 0};
+static uint8_t i2c_reg = 0;
+static uint8_t spi_reg = 0;
+static int16_t gyro[3] = {0, 0, 0};
+static uint8_t flash[SHIM_FLASH_SIZE];
+static shim_usb_stats_t usb_stats = {0,};
+
+// Each HID endpoint stays busy after a report until the next frame, when
+// the transfer completes and tud_task() runs the completion callback.
+#define SHIM_HID_INSTANCES 3
+static bool hid_busy[SHIM_HID_INSTANCES] = {false,};
+static uint64_t hid_busy_until[SHIM_HID_INSTANCES] = {0,};
+
+// Same for the IN endpoint of the vendor class driver (XInput), whose
+// completion is reported to the driver xfer_cb().
+static uint8_t edpt_busy_addr = 0;
+static uint16_t edpt_busy_len = 0;
+static uint64_t edpt_busy_until = 0;
+
+struct i2c_inst {int index;};
+struct spi_inst {int index;};
+static i2c_inst_t i2c1_inst = {1};
+static spi_inst_t spi1_inst = {1};
+i2c_inst_t *i2c1 = &i2c1_inst;
+spi_inst_t *spi1 = &spi1_inst;
+
+// Time.
+
+static void alarms_fire() {
+    for(uint16_t i=0; i<SHIM_ALARMS; i++) {
+        if (!alarms[i].active || alarms[i].due > clock_us) continue;
+        alarms[i].active = false;
+        alarms[i].callback((alarm_id_t)(i + 1), alarms[i].user_data);
+    }
+    for(uint8_t i=0; i<4; i++) {
+        if (!hardware_alarm_armed[i] || hardware_alarm_targets[i] > clock_us) continue;
+        hardware_alarm_armed[i] = false;
+        if (hardware_alarm_callbacks[i]) hardware_alarm_callbacks[i](i);
+    }
+}
+
+// Earliest pending alarm, used to skip idle time when the firmware waits
+// for an event.
+static bool alarms_next(uint64_t *due) {
+    bool found = false;
+    for(uint16_t i=0; i<SHIM_ALARMS; i++) {
+        if (!alarms[i].active) continue;
+        if (!found || alarms[i].due < *due) *due = alarms[i].due;
+        found = true;
+    }
+    for(uint8_t i=0; i<4; i++) {
+        if (!hardware_alarm_armed[i]) continue;
+        if (!found || hardware_alarm_targets[i] < *due) *due = hardware_alarm_targets[i];
+        found = true;
+    }
+    return found;
+}
+
+static usb_hw_t usb_hw_inst = {0};
+static systick_hw_t systick_hw_inst = {0};
+systick_hw_t *systick_hw = &systick_hw_inst;
+
+uint32_t clock_get_hz(enum clock_index clk_index) {
+    return 125000000;
+}
+
+usb_hw_t *usb_hw = &usb_hw_inst;
+
+static void adc_dma_step();
+
+void shim_clock_advance(uint64_t us) {
+    clock_us += us;
+    adc_dma_step();
+    usb_hw_inst.sof_rd = (clock_us / 1000) & 0x7ff;
+    systick_hw_inst.cvr = (0xFFFFFF - (clock_us * 125)) & 0xFFFFFF;
+    alarms_fire();
+}
+
+uint32_t time_us_32() {
+    return (uint32_t)clock_us;
+}
+
+uint64_t time_us_64() {
+    return clock_us;
+}
+
+absolute_time_t get_absolute_time() {
+    return clock_us;
+}
+
+uint32_t to_ms_since_boot(absolute_time_t t) {
+    return (uint32_t)(t / 1000);
+}
+
+uint64_t to_us_since_boot(absolute_time_t t) {
+    return t;
+}
+
+absolute_time_t from_us_since_boot(uint64_t us) {
+    return us;
+}
+
+void sleep_us(uint64_t us) {
+    shim_clock_advance(us);
+}
+
+void sleep_ms(uint32_t ms) {
+    shim_clock_advance((uint64_t)ms * 1000);
+}
+
+alarm_id_t add_alarm_in_us(
+    uint64_t us,
+    alarm_callback_t callback,
+    void *user_data,
+    bool fire_if_past
+) {
+    for(uint16_t i=0; i<SHIM_ALARMS; i++) {
+        if (alarms[i].active) continue;
+        alarms[i] = (shim_alarm_t){true, clock_us + us, callback, user_data};
+        return (alarm_id_t)(i + 1);
+    }
+    return -1;
+}
+
+alarm_id_t add_alarm_in_ms(
+    uint32_t ms,
+    alarm_callback_t callback,
+    void *user_data,
+    bool fire_if_past
+) {
+    return add_alarm_in_us((uint64_t)ms * 1000, callback, user_data, fire_if_past);
+}
+
+bool cancel_alarm(alarm_id_t alarm) {
+    if (alarm < 1 || alarm > SHIM_ALARMS) return false;
+    bool was_active = alarms[alarm - 1].active;
+    alarms[alarm - 1].active = false;
+    return was_active;
+}
+
+alarm_pool_t *alarm_pool_create(uint hardware_alarm_num, uint max_timers) {
+    return (alarm_pool_t*)alarms;
+}
+
+alarm_id_t alarm_pool_add_alarm_in_ms(
+    alarm_pool_t *pool,
+    uint32_t ms,
+    alarm_callback_t callback,
+    void *user_data,
+    bool fire_if_past
+) {
+    return add_alarm_in_ms(ms, callback, user_data, fire_if_past);
+}
+
+bool alarm_pool_cancel_alarm(alarm_pool_t *pool, alarm_id_t alarm) {
+    return cancel_alarm(alarm);
+}
+
+bool add_repeating_timer_ms(
+    int32_t ms,
+    repeating_timer_callback_t callback,
+    void *user_data,
+    repeating_timer_t *out
+) {
+    // LED animations only, not relevant for the host.
+    return true;
+}
+
+bool cancel_repeating_timer(repeating_timer_t *timer) {
+    return true;
+}
+
+int hardware_alarm_claim_unused(bool required) {
+    return 0;
+}
+
+void hardware_alarm_set_callback(uint alarm_num, hardware_alarm_callback_t callback) {
+    hardware_alarm_callbacks[alarm_num & 3] = callback;
+}
+
+bool hardware_alarm_set_target(uint alarm_num, absolute_time_t t) {
+    if (t <= clock_us) return true;
+    hardware_alarm_targets[alarm_num & 3] = t;
+    hardware_alarm_armed[alarm_num & 3] = true;
+    return false;
+}
+
+// Stdio.
+
+void stdio_init_all() {}
+
+void stdio_uart_init() {}
+
+int getchar_timeout_us(uint32_t timeout_us) {
+    return -1;
+}
+
+// Misc system.
+
+void reset_usb_boot(uint32_t gpio_mask, uint32_t interface_disable_mask) {
+    printf("SHIM: reset_usb_boot\n");
+    exit(0);
+}
+
+void watchdog_enable(uint32_t delay_ms, bool pause_on_debug) {
+    printf("SHIM: watchdog_enable\n");
+}
+
+void pico_get_unique_board_id_string(char *id_out, uint len) {
+    snprintf(id_out, len, "HOST");
+}
+
+uint32_t save_and_disable_interrupts() {
+    return 0;
+}
+
+void restore_interrupts(uint32_t status) {}
+
+void multicore_launch_core1(void (*entry)(void)) {
+    printf("SHIM: core 1 is not emulated\n");
+}
+
+// Waiting for an event jumps the virtual clock to the next alarm.
+void __wfi() {
+    uint64_t due;
+    bool found = alarms_next(&due);
+    // A completing HID transfer is an USB interrupt.
+    for(uint8_t i=0; i<SHIM_HID_INSTANCES; i++) {
+        if (!hid_busy[i] || hid_busy_until[i] <= clock_us) continue;
+        if (!found || hid_busy_until[i] < due) due = hid_busy_until[i];
+        found = true;
+    }
+    if (edpt_busy_addr && edpt_busy_until > clock_us) {
+        if (!found || edpt_busy_until < due) due = edpt_busy_until;
+        found = true;
+    }
+    if (found && due > clock_us) shim_clock_advance(due - clock_us);
+    else alarms_fire();
+}
+
+void __wfe() {
+    __wfi();
+}
+
+void __sev() {}
+
+void __dmb() {
+    __sync_synchronize();
+}
+
+// Busy loops spend one virtual microsecond per iteration.
+void tight_loop_contents() {
+    shim_clock_advance(1);
+}
+
+// GPIO.
+
+void gpio_init(uint gpio) {}
+
+void gpio_set_dir(uint gpio, bool out) {}
+
+void gpio_pull_up(uint gpio) {
+    if (gpio < SHIM_GPIOS) gpio_inputs[gpio] = true;
+}
+
+void gpio_set_pulls(uint gpio, bool up, bool down) {
+    // Floating pins read high, so touch measurements resolve immediately.
+    if (gpio < SHIM_GPIOS) gpio_inputs[gpio] = !down;
+}
+
+void gpio_set_function(uint gpio, uint fn) {}
+
+bool gpio_get(uint gpio) {
+    return gpio < SHIM_GPIOS ? gpio_inputs[gpio] : false;
+}
+
+void gpio_put(uint gpio, bool value) {}
+
+void gpio_set_irq_enabled(uint gpio, uint32_t events, bool enabled) {}
+
+void gpio_set_irq_enabled_with_callback(
+    uint gpio,
+    uint32_t events,
+    bool enabled,
+    gpio_irq_callback_t callback
+) {
+    gpio_callback = callback;
+}
+
+void shim_gpio_set_input(uint gpio, bool value) {
+    if (gpio >= SHIM_GPIOS) return;
+    bool changed = gpio_inputs[gpio] != value;
+    gpio_inputs[gpio] = value;
+    if (changed && gpio_callback) {
+        gpio_callback(gpio, value ? GPIO_IRQ_EDGE_RISE : GPIO_IRQ_EDGE_FALL);
+    }
+}
+
+// ADC.
+
+void adc_init() {}
+
+void adc_gpio_init(uint gpio) {}
+
+void adc_select_input(uint input) {
+    adc_input = input & 0b11;
+}
+
+uint16_t adc_read() {
+    return adc_values[adc_input];
+}
+
+void shim_adc_set(uint input, uint16_t value) {
+    adc_values[input & 0b11] = value;
+}
+
+// Free-running ADC into a single DMA channel.
+static adc_hw_t adc_hw_inst = {0};
+adc_hw_t *adc_hw = &adc_hw_inst;
+static uint adc_round_robin = 0;
+static float adc_clkdiv = 0;
+static bool adc_running = false;
+static uint64_t adc_produced = 0;  // Samples since the ADC started.
+static uint64_t adc_start_us = 0;
+static dma_channel_hw_t dma_hw_inst = {0};
+static dma_channel_config dma_config;
+static uint16_t *dma_write = NULL;
+static uint32_t dma_index = 0;
+
+void adc_fifo_setup(bool en, bool dreq_en, uint16_t dreq_thresh, bool err_in_fifo, bool byte_shift) {}
+
+void adc_set_round_robin(uint input_mask) {
+    adc_round_robin = input_mask & 0b1111;
+}
+
+void adc_set_clkdiv(float clkdiv) {
+    adc_clkdiv = clkdiv;
+}
+
+void adc_run(bool run) {
+    adc_running = run;
+    adc_produced = 0;
+    adc_start_us = clock_us;
+}
+
+void adc_fifo_drain() {}
+
+static void adc_dma_step() {
+    if (!adc_running || !dma_write) return;
+    // 48MHz ADC clock, a conversion takes at least 96 cycles.
+    double rate = 48000000.0 / (adc_clkdiv < 96 ? 96 : adc_clkdiv + 1);
+    uint64_t due = (clock_us - adc_start_us) * rate / 1000000;
+    uint32_t ring_len = (1 << dma_config.ring_bits) / sizeof(uint16_t);
+    // Long jumps of the clock only need the most recent samples written,
+    // skipping whole round-robin cycles of two inputs.
+    if (due - adc_produced > ring_len * 2) {
+        uint64_t skip = due - adc_produced - ring_len * 2;
+        skip -= skip % 2;
+        if (skip > dma_hw_inst.transfer_count) skip = dma_hw_inst.transfer_count;
+        adc_produced += skip;
+        dma_index += skip;
+        dma_hw_inst.transfer_count -= skip;
+    }
+    while (adc_produced < due && dma_hw_inst.transfer_count) {
+        dma_write[dma_index & (ring_len - 1)] = adc_values[adc_input];
+        dma_index++;
+        dma_hw_inst.transfer_count--;
+        adc_produced++;
+        do {
+            adc_input = (adc_input + 1) & 0b11;
+        } while (adc_round_robin && !(adc_round_robin & (1 << adc_input)));
+    }
+}
+
+int dma_claim_unused_channel(bool required) {
+    return 0;
+}
+
+dma_channel_config dma_channel_get_default_config(uint channel) {
+    return (dma_channel_config){0,};
+}
+
+void channel_config_set_transfer_data_size(dma_channel_config *c, enum dma_channel_transfer_size size) {}
+
+void channel_config_set_read_increment(dma_channel_config *c, bool incr) {}
+
+void channel_config_set_write_increment(dma_channel_config *c, bool incr) {
+    c->write_increment = incr;
+}
+
+void channel_config_set_ring(dma_channel_config *c, bool write, uint size_bits) {
+    c->ring_write = write;
+    c->ring_bits = size_bits;
+}
+
+void channel_config_set_dreq(dma_channel_config *c, uint dreq) {
+    c->dreq = dreq;
+}
+
+void dma_channel_configure(uint channel, const dma_channel_config *config, volatile void *write_addr, const volatile void *read_addr, uint transfer_count, bool trigger) {
+    // Only a ring written from the ADC FIFO is supported.
+    if (read_addr != &adc_hw->fifo || !config->ring_write) {
+        printf("SHIM: unsupported DMA configuration\n");
+        return;
+    }
+    dma_config = *config;
+    dma_write = (uint16_t*)write_addr;
+    dma_index = 0;
+    dma_hw_inst.transfer_count = trigger ? transfer_count : 0;
+}
+
+void dma_channel_set_write_addr(uint channel, volatile void *write_addr, bool trigger) {
+    dma_write = (uint16_t*)write_addr;
+    dma_index = 0;
+}
+
+dma_channel_hw_t *dma_channel_hw_addr(uint channel) {
+    return &dma_hw_inst;
+}
+
+bool dma_channel_is_busy(uint channel) {
+    return dma_hw_inst.transfer_count > 0;
+}
+
+void dma_channel_set_trans_count(uint channel, uint32_t trans_count, bool trigger) {
+    dma_hw_inst.transfer_count = trans_count;
+}
+
+// I2C and SPI.
+
+uint i2c_init(i2c_inst_t *i2c, uint baudrate) {
+    return baudrate;
+}
+
+int i2c_write_blocking(
+    i2c_inst_t *i2c,
+    uint8_t addr,
+    const uint8_t *src,
+    size_t len,
+    bool nostop
+) {
+    i2c_reg = src[0];
+    return (int)len;
+}
+
+int i2c_read_blocking(
+    i2c_inst_t *i2c,
+    uint8_t addr,
+    uint8_t *dst,
+    size_t len,
+    bool nostop
+) {
+    memset(dst, 0, len);
+    if (i2c_reg == 0x00 && len == 2) {
+        uint16_t value = io_values[addr & 0b1];
+        memcpy(dst, &value, 2);
+    }
+    return (int)len;
+}
+
+void shim_io_set(uint8_t device, uint16_t value) {
+    io_values[device & 0b1] = value;
+}
+
+uint spi_init(spi_inst_t *spi, uint baudrate) {
+    return baudrate;
+}
+
+int spi_write_blocking(spi_inst_t *spi, const uint8_t *src, size_t len) {
+    spi_reg = src[0] & 0b01111111;
+    return (int)len;
+}
+
+int spi_read_blocking(
+    spi_inst_t *spi,
+    uint8_t repeated_tx_data,
+    uint8_t *dst,
+    size_t len
+) {
+    memset(dst, 0, len);
+    if (spi_reg == 0x22 && len == 6) {
+        // Register order is X, Y, Z but the firmware remaps the axes.
+        int16_t values[3] = {gyro[1], gyro[2], (int16_t)-gyro[0]};
+        memcpy(dst, values, 6);
+    }
+    return (int)len;
+}
+
+void shim_gyro_set(int16_t x, int16_t y, int16_t z) {
+    gyro[0] = x;
+    gyro[1] = y;
+    gyro[2] = z;
+}
+
+// PWM.
+
+uint pwm_gpio_to_slice_num(uint gpio) {
+    return (gpio >> 1) & 7;
+}
+
+void pwm_set_wrap(uint slice_num, uint16_t wrap) {}
+
+void pwm_set_enabled(uint slice_num, bool enabled) {}
+
+void pwm_set_gpio_level(uint gpio, uint16_t level) {}
+
+// Flash and NVM.
+// The firmware reads flash through a raw XIP address, which cannot be mapped
+// on a 64-bit host, so NVM is reimplemented over a plain buffer.
+
+void flash_range_erase(uint32_t flash_offs, size_t count) {
+    if (flash_offs + count > SHIM_FLASH_SIZE) return;
+    memset(flash + flash_offs, 0xFF, count);
+}
+
+void flash_range_program(uint32_t flash_offs, const uint8_t *data, size_t count) {
+    if (flash_offs + count > SHIM_FLASH_SIZE) return;
+    memcpy(flash + flash_offs, data, count);
+}
+
+void nvm_write(uint32_t addr, uint8_t* buffer, uint32_t size) {
+    flash_range_erase(addr, size > 4096 ? size : 4096);
+    flash_range_program(addr, buffer, size);
+}
+
+void nvm_read(uint32_t addr, uint8_t* buffer, uint32_t size) {
+    if (addr + size > SHIM_FLASH_SIZE) return;
+    memcpy(buffer, flash + addr, size);
+}
+
+// TinyUSB.
+
+static void usb_hash(const void *data, uint16_t len) {
+    if (usb_stats.hash == 0) usb_stats.hash = 2166136261u;
+    for(uint16_t i=0; i<len; i++) {
+        usb_stats.hash ^= ((const uint8_t*)data)[i];
+        usb_stats.hash *= 16777619u;
+    }
+}
+
+bool tusb_init() {
+    return true;
+}
+
+void tud_task() {
+    for(uint8_t i=0; i<SHIM_HID_INSTANCES; i++) {
+        if (!hid_busy[i] || clock_us < hid_busy_until[i]) continue;
+        hid_busy[i] = false;
+        tud_hid_report_complete_cb(i, NULL, 0);
+    }
+    if (edpt_busy_addr && clock_us >= edpt_busy_until) {
+        uint8_t addr = edpt_busy_addr;
+        edpt_busy_addr = 0;
+        uint8_t count;
+        usbd_class_driver_t const *driver = usbd_app_driver_get_cb(&count);
+        driver->xfer_cb(0, addr, XFER_RESULT_SUCCESS, edpt_busy_len);
+    }
+}
+
+bool tud_ready() {
+    return true;
+}
+
+bool tud_suspended() {
+    return false;
+}
+
+bool tud_remote_wakeup() {
+    return true;
+}
+
+bool tud_hid_n_ready(uint8_t instance) {
+    return !hid_busy[instance];
+}
+
+bool tud_hid_ready() {
+    return tud_hid_n_ready(0);
+}
+
+static uint8_t hid_protocol = HID_PROTOCOL_REPORT;
+
+uint8_t tud_hid_n_get_protocol(uint8_t instance) {
+    return instance == 0 ? hid_protocol : HID_PROTOCOL_REPORT;
+}
+
+uint8_t tud_hid_get_protocol() {
+    return tud_hid_n_get_protocol(0);
+}
+
+void shim_hid_set_protocol(uint8_t protocol) {
+    hid_protocol = protocol;
+}
+
+bool tud_hid_n_report(uint8_t instance, uint8_t report_id, void const *report, uint8_t len) {
+    if (hid_busy[instance]) return false;
+    hid_busy[instance] = true;
+    hid_busy_until[instance] = (clock_us / 1000 + 1) * 1000;
+    usb_stats.reports++;
+    usb_stats.report_bytes += len + (report_id ? 1 : 0);
+    usb_hash(&report_id, 1);
+    usb_hash(report, len);
+    return true;
+}
+
+bool tud_hid_report(uint8_t report_id, void const *report, uint8_t len) {
+    return tud_hid_n_report(0, report_id, report, len);
+}
+
+bool tud_hid_n_keyboard_report(
+    uint8_t instance,
+    uint8_t report_id,
+    uint8_t modifier,
+    uint8_t keycode[6]
+) {
+    uint8_t report[8] = {modifier, 0,};
+    if (keycode) memcpy(report + 2, keycode, 6);
+    return tud_hid_n_report(instance, report_id, report, 8);
+}
+
+bool tud_hid_keyboard_report(uint8_t report_id, uint8_t modifier, uint8_t keycode[6]) {
+    return tud_hid_n_keyboard_report(0, report_id, modifier, keycode);
+}
+
+bool tud_hid_n_mouse_report(
+    uint8_t instance,
+    uint8_t report_id,
+    uint8_t buttons,
+    int8_t x,
+    int8_t y,
+    int8_t vertical,
+    int8_t horizontal
+) {
+    int8_t report[5] = {(int8_t)buttons, x, y, vertical, horizontal};
+    return tud_hid_n_report(instance, report_id, report, 5);
+}
+
+bool tud_hid_mouse_report(
+    uint8_t report_id,
+    uint8_t buttons,
+    int8_t x,
+    int8_t y,
+    int8_t vertical,
+    int8_t horizontal
+) {
+    return tud_hid_n_mouse_report(0, report_id, buttons, x, y, vertical, horizontal);
+}
+
+bool tud_control_xfer(
+    uint8_t rhport,
+    tusb_control_request_t const *request,
+    void *buffer,
+    uint16_t len
+) {
+    return true;
+}
+
+bool usbd_edpt_open(uint8_t rhport, tusb_desc_endpoint_t const *desc_ep) {
+    return true;
+}
+
+bool usbd_edpt_busy(uint8_t rhport, uint8_t ep_addr) {
+    return ep_addr == edpt_busy_addr;
+}
+
+bool usbd_edpt_claim(uint8_t rhport, uint8_t ep_addr) {
+    return true;
+}
+
+bool usbd_edpt_release(uint8_t rhport, uint8_t ep_addr) {
+    return true;
+}
+
+bool usbd_edpt_xfer(uint8_t rhport, uint8_t ep_addr, uint8_t *buffer, uint16_t total_bytes) {
+    // OUT transfers are armed but the host never sends anything.
+    if (ep_addr & 0x80) {
+        if (edpt_busy_addr) return false;
+        edpt_busy_addr = ep_addr;
+        edpt_busy_len = total_bytes;
+        edpt_busy_until = (clock_us / 1000 + 1) * 1000;
+        usb_stats.xfers++;
+        usb_stats.xfer_bytes += total_bytes;
+        usb_hash(buffer, total_bytes);
+    }
+    return true;
+}
+
+shim_usb_stats_t *shim_usb_get_stats() {
+    return &usb_stats;
+}
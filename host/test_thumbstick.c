@@ -0,0 +1,384 @@
+// SPDX-License-Identifier: GPL-2.0-only
+// Copyright (C) 2022, Input Labs Oy.
+
+// Host test of the fixed-point thumbstick pipeline.
+// Sweeps the raw ADC range for every deadzone preset and compares the axis
+// values, and the direction sectors for several overlaps, against the former
+// floating point implementation, which is kept here as the reference. The
+// response curve tables are checked against the curves evaluated directly,
+// and end to end through a gamepad thumbstick reporting with a curve.
+// Timings are host nanoseconds per call, only meaningful relative to each
+// other.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include "config.h"
+#include "helper.h"
+#include "thumbstick.h"
+#include "button.h"
+#include "pin.h"
+#include "hid.h"
+
+#define TEST_STEP 4
+#define TEST_MAX_AXIS_ERROR 3  // Output units of the 16-bit axes.
+#define TEST_SECTOR_MARGIN 0.05  // Degrees around a cut where either side is accepted.
+#define TEST_MAX_CURVE_ERROR 4  // Q15.
+#define TEST_MAX_REPORT_ERROR 8  // Output units, position and curve errors combined.
+
+typedef struct {
+    const char *name;
+    ThumbstickCurve curve;
+    float anti_deadzone;
+    double params[4];
+    uint8_t len;
+} TestCurve;
+
+typedef struct {
+    float x;
+    float y;
+    float angle;
+    float radius;
+} RefPosition;
+
+float ref_axis(uint16_t raw) {
+    float value = (float)raw - 2048;
+    value = value / 2048 * CFG_THUMBSTICK_SATURATION;
+    return limit_between(value, -1, 1);
+}
+
+RefPosition ref_position(uint16_t raw_x, uint16_t raw_y, float deadzone) {
+    float x = ref_axis(raw_x);
+    float y = ref_axis(raw_y);
+    float angle = atan2(x, -y) * (180 / M_PI);
+    float radius = sqrt(powf(x, 2) + powf(y, 2));
+    radius = limit_between(radius, 0, 1);
+    radius = ramp_low(radius, deadzone);
+    x = sin(radians(angle)) * radius;
+    y = -cos(radians(angle)) * radius;
+    return (RefPosition){x, y, angle, radius};
+}
+
+uint8_t ref_dir4_mask(float angle, float overlap) {
+    float cutA = 45 * (-overlap + 1);
+    float cutB = 180 - cutA;
+    uint8_t mask = 0;
+    if (is_between(angle, -cutB, -cutA)) mask |= DIR4_MASK_LEFT;
+    if (is_between(angle, cutA, cutB)) mask |= DIR4_MASK_RIGHT;
+    if (fabs(angle) <= 90 - cutA) mask |= DIR4_MASK_UP;
+    if (fabs(angle) >= 90 + cutA) mask |= DIR4_MASK_DOWN;
+    return mask;
+}
+
+Dir4 ref_dir4(float angle) {
+    float CUT4 = 45;
+    float CUT4X = 135;
+    if      (is_between(angle, -CUT4X, -CUT4)) return DIR4_LEFT;
+    else if (is_between(angle,  CUT4,  CUT4X)) return DIR4_RIGHT;
+    else if (fabs(angle) <= 90 - CUT4)         return DIR4_UP;
+    else if (fabs(angle) >= 90 + CUT4)         return DIR4_DOWN;
+    return DIR4_CENTER;
+}
+
+Dir8 ref_dir8(float angle) {
+    float CUT8 = 22.5;
+    if      (is_between(angle, -CUT8*1,  CUT8*1)) return DIR8_UP;
+    else if (is_between(angle,  CUT8*1,  CUT8*3)) return DIR8_UP_RIGHT;
+    else if (is_between(angle,  CUT8*3,  CUT8*5)) return DIR8_RIGHT;
+    else if (is_between(angle,  CUT8*5,  CUT8*7)) return DIR8_DOWN_RIGHT;
+    else if (is_between(angle, -CUT8*7, -CUT8*5)) return DIR8_DOWN_LEFT;
+    else if (is_between(angle, -CUT8*5, -CUT8*3)) return DIR8_LEFT;
+    else if (is_between(angle, -CUT8*3, -CUT8*1)) return DIR8_UP_LEFT;
+    else if (fabs(angle) >= CUT8*7)               return DIR8_DOWN;
+    return DIR8_CENTER;
+}
+
+// Angle wrapped into (-180, 180].
+float ref_wrap(float angle) {
+    if (angle > 180) return angle - 360;
+    if (angle <= -180) return angle + 360;
+    return angle;
+}
+
+// Response curve evaluated directly, with the anti-deadzone applied.
+double ref_curve(TestCurve *test, double t) {
+    if (t == 0) return 0;
+    double value = t;
+    double k = test->params[0];
+    if (test->curve == CURVE_EXPONENTIAL) value = pow(t, k);
+    if (test->curve == CURVE_S) value = pow(t, k) / (pow(t, k) + pow(1 - t, k));
+    if (test->curve == CURVE_POINTS) {
+        double xs[] = {0, test->params[0], test->params[2], 1};
+        double ys[] = {0, test->params[1], test->params[3], 1};
+        for(uint8_t i=1; i<4; i++) {
+            if (t <= xs[i]) {
+                value = ys[i-1] + (ys[i] - ys[i-1]) * (t - xs[i-1]) / (xs[i] - xs[i-1]);
+                break;
+            }
+        }
+    }
+    return test->anti_deadzone + (1 - test->anti_deadzone) * value;
+}
+
+uint64_t test_now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// TinyUSB callback from tusb_config.c, which is not part of the host build.
+void tud_hid_report_complete_cb(uint8_t instance, uint8_t const *report, uint8_t len) {}
+
+// Keeps the optimizer from dropping the timed calls.
+volatile int32_t test_sink;
+
+// Gamepad axes state from hid.c.
+extern int16_t gamepad_lx;
+extern int16_t gamepad_ly;
+
+bool test_deadzone(float deadzone) {
+    int32_t deadzone_q15 = THUMBSTICK_Q15(deadzone);
+    uint32_t total = 0;
+    uint32_t exact = 0;
+    int32_t max_axis_error = 0;
+    for(uint32_t raw_x=0; raw_x<4096; raw_x+=TEST_STEP) {
+        for(uint32_t raw_y=0; raw_y<4096; raw_y+=TEST_STEP) {
+            RefPosition ref = ref_position(raw_x, raw_y, deadzone);
+            int32_t x = thumbstick_axis(raw_x, 0);
+            int32_t y = thumbstick_axis(raw_y, 0);
+            ThumbstickPosition pos = thumbstick_position(x, y, deadzone_q15);
+            int16_t axes[2] = {
+                pos.x * ANALOG_FACTOR / THUMBSTICK_ONE,
+                pos.y * ANALOG_FACTOR / THUMBSTICK_ONE,
+            };
+            int16_t ref_axes[2] = {
+                ref.x * ANALOG_FACTOR,
+                ref.y * ANALOG_FACTOR,
+            };
+            for(uint8_t i=0; i<2; i++) {
+                int32_t error = abs(axes[i] - ref_axes[i]);
+                max_axis_error = max(max_axis_error, error);
+                exact += error == 0;
+                total += 1;
+            }
+        }
+    }
+    uint32_t calls = 0;
+    uint64_t start = test_now_ns();
+    for(uint32_t raw_x=0; raw_x<4096; raw_x+=TEST_STEP) {
+        for(uint32_t raw_y=0; raw_y<4096; raw_y+=TEST_STEP) {
+            RefPosition ref = ref_position(raw_x, raw_y, deadzone);
+            test_sink = ref.x * ANALOG_FACTOR;
+            calls += 1;
+        }
+    }
+    double ref_ns = (double)(test_now_ns() - start) / calls;
+    start = test_now_ns();
+    for(uint32_t raw_x=0; raw_x<4096; raw_x+=TEST_STEP) {
+        for(uint32_t raw_y=0; raw_y<4096; raw_y+=TEST_STEP) {
+            int32_t x = thumbstick_axis(raw_x, 0);
+            int32_t y = thumbstick_axis(raw_y, 0);
+            ThumbstickPosition pos = thumbstick_position(x, y, deadzone_q15);
+            test_sink = pos.x;
+        }
+    }
+    double fixed_ns = (double)(test_now_ns() - start) / calls;
+    bool passed = max_axis_error <= TEST_MAX_AXIS_ERROR;
+    printf(
+        "TEST: deadzone=%.2f exact=%.2f%% max_axis_error=%i "
+        "ns/call float=%.1f fixed=%.1f %s\n",
+        deadzone,
+        100.0 * exact / total,
+        max_axis_error,
+        ref_ns,
+        fixed_ns,
+        passed ? "OK" : "FAIL"
+    );
+    return passed;
+}
+
+// Sectors of every position out of the center, a mismatch is an error
+// unless the reference angle is within the margin of a cut.
+bool test_sectors(float overlap) {
+    int32_t cut_sin = THUMBSTICK_Q15(sin(radians(45 * (-overlap + 1))));
+    int32_t cut_cos = THUMBSTICK_Q15(cos(radians(45 * (-overlap + 1))));
+    uint32_t total = 0;
+    uint32_t errors = 0;
+    uint32_t margin = 0;
+    for(uint32_t raw_x=0; raw_x<4096; raw_x+=TEST_STEP) {
+        for(uint32_t raw_y=0; raw_y<4096; raw_y+=TEST_STEP) {
+            int32_t x = thumbstick_axis(raw_x, 0);
+            int32_t y = thumbstick_axis(raw_y, 0);
+            if (!x && !y) continue;
+            float angle = atan2((float)x, (float)-y) * (180 / M_PI);
+            float low = ref_wrap(angle - TEST_SECTOR_MARGIN);
+            float high = ref_wrap(angle + TEST_SECTOR_MARGIN);
+            uint8_t mask = thumbstick_dir4_mask(x, y, cut_sin, cut_cos);
+            Dir4 dir4 = thumbstick_dir4(x, y);
+            Dir8 dir8 = thumbstick_dir8(x, y);
+            bool exact = (
+                mask == ref_dir4_mask(angle, overlap) &&
+                dir4 == ref_dir4(angle) &&
+                dir8 == ref_dir8(angle)
+            );
+            bool near = (
+                (mask == ref_dir4_mask(low, overlap) || mask == ref_dir4_mask(high, overlap)) &&
+                (dir4 == ref_dir4(low) || dir4 == ref_dir4(high) || dir4 == ref_dir4(angle)) &&
+                (dir8 == ref_dir8(low) || dir8 == ref_dir8(high) || dir8 == ref_dir8(angle))
+            );
+            total += 1;
+            if (!exact && near) margin += 1;
+            if (!exact && !near) errors += 1;
+        }
+    }
+    uint64_t start = test_now_ns();
+    for(uint32_t raw_x=0; raw_x<4096; raw_x+=TEST_STEP) {
+        for(uint32_t raw_y=0; raw_y<4096; raw_y+=TEST_STEP) {
+            float x = ref_axis(raw_x);
+            float y = ref_axis(raw_y);
+            float angle = atan2(x, -y) * (180 / M_PI);
+            test_sink = ref_dir4_mask(angle, overlap) + ref_dir8(angle);
+        }
+    }
+    double ref_ns = (double)(test_now_ns() - start) / total;
+    start = test_now_ns();
+    for(uint32_t raw_x=0; raw_x<4096; raw_x+=TEST_STEP) {
+        for(uint32_t raw_y=0; raw_y<4096; raw_y+=TEST_STEP) {
+            int32_t x = thumbstick_axis(raw_x, 0);
+            int32_t y = thumbstick_axis(raw_y, 0);
+            test_sink = thumbstick_dir4_mask(x, y, cut_sin, cut_cos) + thumbstick_dir8(x, y);
+        }
+    }
+    double fixed_ns = (double)(test_now_ns() - start) / total;
+    printf(
+        "TEST: overlap=%.2f sectors=%u at_cut=%u errors=%u "
+        "ns/call float=%.1f fixed=%.1f %s\n",
+        overlap,
+        total,
+        margin,
+        errors,
+        ref_ns,
+        fixed_ns,
+        errors ? "FAIL" : "OK"
+    );
+    return !errors;
+}
+
+// Every input radius, the first table segment is skipped when there is an
+// anti-deadzone, since the table ramps up to it there by design.
+bool test_curve(TestCurve *test) {
+    uint16_t lut[THUMBSTICK_CURVE_LEN];
+    thumbstick_curve_build(lut, test->curve, test->anti_deadzone, test->params, test->len);
+    int32_t start = test->anti_deadzone ? THUMBSTICK_ONE / (THUMBSTICK_CURVE_LEN - 1) : 0;
+    int32_t max_error = 0;
+    for(int32_t radius=start; radius<=THUMBSTICK_ONE; radius++) {
+        double ref = ref_curve(test, (double)radius / THUMBSTICK_ONE);
+        int32_t error = abs(thumbstick_curve(lut, radius) - (int32_t)lround(ref * THUMBSTICK_ONE));
+        max_error = max(max_error, error);
+    }
+    uint32_t calls = THUMBSTICK_ONE + 1;
+    uint64_t start_ns = test_now_ns();
+    for(int32_t radius=0; radius<=THUMBSTICK_ONE; radius++) {
+        test_sink = ref_curve(test, (double)radius / THUMBSTICK_ONE) * THUMBSTICK_ONE;
+    }
+    double ref_ns = (double)(test_now_ns() - start_ns) / calls;
+    start_ns = test_now_ns();
+    for(int32_t radius=0; radius<=THUMBSTICK_ONE; radius++) {
+        test_sink = thumbstick_curve(lut, radius);
+    }
+    double lut_ns = (double)(test_now_ns() - start_ns) / calls;
+    bool passed = max_error <= TEST_MAX_CURVE_ERROR;
+    printf(
+        "TEST: curve=%s max_error=%i ns/call float=%.1f lut=%.1f %s\n",
+        test->name,
+        max_error,
+        ref_ns,
+        lut_ns,
+        passed ? "OK" : "FAIL"
+    );
+    return passed;
+}
+
+// The gamepad axes of a thumbstick configured with a curve, against the
+// reference position with the curve applied along the radius.
+bool test_report(TestCurve *test, float deadzone) {
+    Thumbstick thumbstick = Thumbstick_(
+        THUMBSTICK_MODE_4DIR,
+        deadzone,
+        0,
+        Button_(PIN_VIRTUAL, NORMAL, ACTIONS(GAMEPAD_AXIS_LX_NEG)),
+        Button_(PIN_VIRTUAL, NORMAL, ACTIONS(GAMEPAD_AXIS_LX)),
+        Button_(PIN_VIRTUAL, NORMAL, ACTIONS(GAMEPAD_AXIS_LY)),
+        Button_(PIN_VIRTUAL, NORMAL, ACTIONS(GAMEPAD_AXIS_LY_NEG)),
+        Button_(PIN_VIRTUAL, NORMAL, ACTIONS(KEY_NONE)),
+        Button_(PIN_VIRTUAL, NORMAL, ACTIONS(KEY_NONE)),
+        Button_(PIN_VIRTUAL, NORMAL, ACTIONS(KEY_NONE))
+    );
+    thumbstick.config_curve(
+        &thumbstick,
+        test->anti_deadzone,
+        test->curve,
+        test->params,
+        test->len
+    );
+    int32_t deadzone_q15 = THUMBSTICK_Q15(deadzone);
+    int32_t max_axis_error = 0;
+    for(uint32_t raw_x=0; raw_x<4096; raw_x+=TEST_STEP) {
+        for(uint32_t raw_y=0; raw_y<4096; raw_y+=TEST_STEP) {
+            RefPosition ref = ref_position(raw_x, raw_y, deadzone);
+            int32_t x = thumbstick_axis(raw_x, 0);
+            int32_t y = thumbstick_axis(raw_y, 0);
+            ThumbstickPosition pos = thumbstick_position(x, y, deadzone_q15);
+            thumbstick.report_4dir(&thumbstick, pos, deadzone_q15);
+            double radius = ref.radius ? ref_curve(test, ref.radius) : 0;
+            int16_t ref_axes[2] = {
+                sin(radians(ref.angle)) * radius * ANALOG_FACTOR,
+                -cos(radians(ref.angle)) * radius * ANALOG_FACTOR,
+            };
+            max_axis_error = max(max_axis_error, abs(gamepad_lx - ref_axes[0]));
+            max_axis_error = max(max_axis_error, abs(gamepad_ly - ref_axes[1]));
+        }
+    }
+    bool passed = max_axis_error <= TEST_MAX_REPORT_ERROR;
+    printf(
+        "TEST: report curve=%s deadzone=%.2f max_axis_error=%i %s\n",
+        test->name,
+        deadzone,
+        max_axis_error,
+        passed ? "OK" : "FAIL"
+    );
+    return passed;
+}
+
+int main() {
+    float deadzones[] = {
+        0,
+        CFG_THUMBSTICK_DEADZONE_LOW,
+        CFG_THUMBSTICK_DEADZONE_MID,
+        CFG_THUMBSTICK_DEADZONE_HIGH,
+        0.25,
+    };
+    bool passed = true;
+    for(uint8_t i=0; i<sizeof(deadzones)/sizeof(deadzones[0]); i++) {
+        passed &= test_deadzone(deadzones[i]);
+    }
+    float overlaps[] = {-1, -0.5, 0, 0.5, 1};
+    for(uint8_t i=0; i<sizeof(overlaps)/sizeof(overlaps[0]); i++) {
+        passed &= test_sectors(overlaps[i]);
+    }
+    TestCurve curves[] = {
+        {"linear",        CURVE_LINEAR,      0,    {0},              0},
+        {"exponential",   CURVE_EXPONENTIAL, 0,    {2.0},            1},
+        {"exponential_3", CURVE_EXPONENTIAL, 0,    {3.0},            1},
+        {"s",             CURVE_S,           0,    {2.0},            1},
+        {"points",        CURVE_POINTS,      0,    {0.25, 0.1, 0.75, 0.5}, 4},
+        {"anti_deadzone", CURVE_LINEAR,      0.15, {0},              0},
+        {"exponential_anti_deadzone", CURVE_EXPONENTIAL, 0.1, {1.5}, 1},
+    };
+    for(uint8_t i=0; i<sizeof(curves)/sizeof(curves[0]); i++) {
+        passed &= test_curve(&curves[i]);
+    }
+    passed &= test_report(&curves[1], CFG_THUMBSTICK_DEADZONE_MID);
+    return passed ? 0 : 1;
+}
@@ -2,6 +2,7 @@
 // Copyright (C) 2022, Input Labs Oy.
 
 #include <stdio.h>
+#include <pico/time.h>
 #include <hardware/gpio.h>
 #include <hardware/i2c.h>
 #include <hardware/spi.h>
@@ -12,6 +13,7 @@
 
 uint16_t io_cache_0;
 uint16_t io_cache_1;
+uint32_t io_cache_timestamp;
 
 int8_t bus_i2c_acknowledge(uint8_t device) {
     uint8_t buf = 0;
@@ -62,6 +64,17 @@ void bus_i2c_io_pcb_gen_determine() {
 void bus_i2c_io_cache_update() {
     io_cache_0 = bus_i2c_read_two(I2C_IO_0, I2C_IO_REG_INPUT);
     io_cache_1 = bus_i2c_read_two(I2C_IO_1, I2C_IO_REG_INPUT);
+    io_cache_timestamp = time_us_32();
+}
+
+void bus_i2c_io_cache_set(uint16_t value_0, uint16_t value_1, uint32_t timestamp) {
+    io_cache_0 = value_0;
+    io_cache_1 = value_1;
+    io_cache_timestamp = timestamp;
+}
+
+uint32_t bus_i2c_io_cache_timestamp() {
+    return io_cache_timestamp;
 }
 
 bool bus_i2c_io_cache_read(uint8_t device_index, uint8_t bit_index) {
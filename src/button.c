@@ -11,6 +11,8 @@
 #include "bus.h"
 #include "pin.h"
 #include "helper.h"
+#include "profiler.h"
+#include "trace.h"
 
 bool Button__is_pressed(Button *self) {
     if (self->pin == PIN_NONE) return false;
@@ -25,19 +27,26 @@ bool Button__is_pressed(Button *self) {
     }
     // Buttons connected directly to Pico.
     else if (is_between(self->pin, PIN_GROUP_PICO, PIN_GROUP_PICO_END)) {
-        return !gpio_get(self->pin);
+        bool pressed = !gpio_get(self->pin);
+        trace_edge(&self->raw_state, pressed, time_us_32());
+        return pressed;
     }
     // Buttons connected to 1st IO expander.
     else if (is_between(self->pin, PIN_GROUP_IO_0, PIN_GROUP_IO_0_END)) {
-        return bus_i2c_io_cache_read(0, self->pin - PIN_GROUP_IO_0);
+        bool pressed = bus_i2c_io_cache_read(0, self->pin - PIN_GROUP_IO_0);
+        trace_edge(&self->raw_state, pressed, bus_i2c_io_cache_timestamp());
+        return pressed;
     }
     // Buttons connected to 2nd IO expander.
     else if (is_between(self->pin, PIN_GROUP_IO_1, PIN_GROUP_IO_1_END)) {
-        return bus_i2c_io_cache_read(1, self->pin - PIN_GROUP_IO_1);
+        bool pressed = bus_i2c_io_cache_read(1, self->pin - PIN_GROUP_IO_1);
+        trace_edge(&self->raw_state, pressed, bus_i2c_io_cache_timestamp());
+        return pressed;
     }
 }
 
 void Button__report(Button *self) {
+    PROFILER_START(PROFILER_BUTTONS);
     if (self->behavior == NORMAL) self->handle_normal(self);
     else if (self->behavior == STICKY) self->handle_sticky(self);
     else if (self->behavior == HOLD_OVERLAP) self->handle_hold_overlap(self);
@@ -48,6 +57,8 @@ void Button__report(Button *self) {
     else if (self->behavior == HOLD_EXCLUSIVE_LONG) {
         self->handle_hold_exclusive(self, CFG_HOLD_EXCLUSIVE_LONG_TIME);
     }
+    trace_edge_clear();
+    PROFILER_STOP(PROFILER_BUTTONS);
 }
 
 void Button__handle_normal(Button *self) {
@@ -201,6 +212,7 @@ Button Button_ (
     button.behavior = behavior;
     button.state = false;
     button.virtual_press = false;
+    button.raw_state = false;
     button.state_secondary = false;
     button.press_timestamp = 0;
     button.hold_timestamp = 0;
@@ -0,0 +1,203 @@
+// SPDX-License-Identifier: GPL-2.0-only
+// Copyright (C) 2022, Input Labs Oy.
+
+// Thumbstick and gyro offsets calibration.
+// Runs from the main loop as a state machine taking a bounded slice of
+// samples per tick, so the controller keeps reporting and USB keeps being
+// serviced. After a delay to leave the controller still, every source is
+// averaged for a fixed duration while the LEDs fill up. A slice too far
+// from the running mean means the controller moved, then the sampling
+// starts over after a new delay, or is given up after a few restarts. The
+// offsets are only stored and applied at the end, all at once.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pico/stdlib.h>
+#include "calibration.h"
+#include "config.h"
+#include "imu.h"
+#include "led.h"
+#include "pin.h"
+#include "profile.h"
+#include "sampler.h"
+#include "thumbstick.h"
+#include "tick.h"
+#include "helper.h"
+
+CalibrationState calibration_state = CALIBRATION_IDLE;
+uint64_t calibration_timestamp = 0;  // Start of the current state.
+uint8_t calibration_restarts = 0;
+int64_t calibration_ts_sum[2];
+uint32_t calibration_ts_len = 0;
+int64_t calibration_imu_sum[2][3];
+uint32_t calibration_imu_len = 0;
+
+// Core 1 must be off the SPI bus while sampling, it is paused once for the
+// whole sampling state instead of around every slice.
+void calibration_leave_sampling() {
+    if (calibration_state == CALIBRATION_SAMPLE) sampler_pause(false);
+}
+
+void calibration_wait(uint16_t delay) {
+    calibration_leave_sampling();
+    calibration_state = CALIBRATION_WAIT;
+    calibration_timestamp = time_us_64() + (delay * 1000);
+    led_shape_all_off();
+    led_blink_mask(LED_MASK_LEFT | LED_MASK_RIGHT);
+}
+
+void calibration_start() {
+    if (calibration_state != CALIBRATION_IDLE) return;
+    printf("Calibration: leave the controller still\n");
+    profile_led_lock = true;
+    calibration_restarts = 0;
+    calibration_wait(CFG_CALIBRATION_DELAY);
+}
+
+void calibration_stop() {
+    calibration_leave_sampling();
+    calibration_state = CALIBRATION_IDLE;
+    led_shape_all_off();
+    profile_led_lock = false;
+    profile_update_leds();
+}
+
+void calibration_restart() {
+    calibration_restarts += 1;
+    if (calibration_restarts > CFG_CALIBRATION_RESTARTS) {
+        printf("Calibration: aborted, the controller kept moving\n");
+        calibration_stop();
+        return;
+    }
+    printf("Calibration: motion detected, restarting\n");
+    calibration_wait(CFG_CALIBRATION_RESTART_DELAY);
+}
+
+void calibration_begin_sampling() {
+    sampler_pause(true);
+    calibration_state = CALIBRATION_SAMPLE;
+    calibration_timestamp = time_us_64();
+    calibration_ts_sum[0] = 0;
+    calibration_ts_sum[1] = 0;
+    calibration_ts_len = 0;
+    for(uint8_t i=0; i<2; i++) {
+        for(uint8_t axis=0; axis<3; axis++) calibration_imu_sum[i][axis] = 0;
+    }
+    calibration_imu_len = 0;
+    led_shape_all_off();
+}
+
+// Whether the mean of a slice deviates from the mean so far, compared
+// cross-multiplied to avoid divisions.
+bool calibration_moved(
+    int64_t sum,
+    uint32_t len,
+    int64_t slice_sum,
+    uint32_t slice_len,
+    int32_t threshold
+) {
+    if (!len) return false;
+    int64_t deviation = slice_sum * len - sum * slice_len;
+    return llabs(deviation) > (int64_t)threshold * len * slice_len;
+}
+
+// One reading per tick, the ADC is already averaged by the DMA decimation
+// or read once per tick by the sampler.
+bool calibration_sample_thumbstick() {
+    thumbstick_adc_update();
+    int32_t values[2] = {thumbstick_adc(1, 0), thumbstick_adc(0, 0)};
+    int32_t threshold = THUMBSTICK_Q15(CFG_CALIBRATION_THUMBSTICK_MOTION);
+    for(uint8_t axis=0; axis<2; axis++) {
+        int64_t sum = calibration_ts_sum[axis];
+        if (calibration_moved(sum, calibration_ts_len, values[axis], 1, threshold)) {
+            return false;
+        }
+    }
+    calibration_ts_sum[0] += values[0];
+    calibration_ts_sum[1] += values[1];
+    calibration_ts_len += 1;
+    return true;
+}
+
+bool calibration_sample_imu() {
+    uint8_t cs[2] = {PIN_SPI_CS0, PIN_SPI_CS1};
+    uint32_t len = max(
+        1,
+        CFG_CALIBRATION_TICK_SAMPLES * CFG_TICK_FREQUENCY_BASE / tick_get_frequency()
+    );
+    int64_t slice[2][3] = {{0,},};
+    for(uint32_t i=0; i<len; i++) {
+        for(uint8_t imu=0; imu<2; imu++) {
+            int16_t axes[3];
+            imu_read_gyro_raw(cs[imu], axes);
+            for(uint8_t axis=0; axis<3; axis++) slice[imu][axis] += axes[axis];
+        }
+    }
+    for(uint8_t imu=0; imu<2; imu++) {
+        for(uint8_t axis=0; axis<3; axis++) {
+            int64_t sum = calibration_imu_sum[imu][axis];
+            if (calibration_moved(
+                sum,
+                calibration_imu_len,
+                slice[imu][axis],
+                len,
+                CFG_CALIBRATION_GYRO_MOTION
+            )) {
+                return false;
+            }
+        }
+    }
+    for(uint8_t imu=0; imu<2; imu++) {
+        for(uint8_t axis=0; axis<3; axis++) {
+            calibration_imu_sum[imu][axis] += slice[imu][axis];
+        }
+    }
+    calibration_imu_len += len;
+    return true;
+}
+
+void calibration_finish() {
+    float tx = (float)calibration_ts_sum[0] / calibration_ts_len / THUMBSTICK_ONE;
+    float ty = (float)calibration_ts_sum[1] / calibration_ts_len / THUMBSTICK_ONE;
+    double imu[2][3];
+    for(uint8_t i=0; i<2; i++) {
+        for(uint8_t axis=0; axis<3; axis++) {
+            imu[i][axis] = (double)calibration_imu_sum[i][axis] / calibration_imu_len;
+        }
+    }
+    printf("Calibration: thumbstick x=%f y=%f\n", tx, ty);
+    printf("Calibration: imu_0 x=%f y=%f z=%f\n", imu[0][0], imu[0][1], imu[0][2]);
+    printf("Calibration: imu_1 x=%f y=%f z=%f\n", imu[1][0], imu[1][1], imu[1][2]);
+    config_set_calibration(
+        tx, ty,
+        imu[0][0], imu[0][1], imu[0][2],
+        imu[1][0], imu[1][1], imu[1][2]
+    );
+    thumbstick_update_offsets();
+    imu_update_offsets();
+    calibration_stop();
+}
+
+void calibration_run() {
+    if (calibration_state == CALIBRATION_IDLE) return;
+    uint64_t now = time_us_64();
+    if (calibration_state == CALIBRATION_WAIT) {
+        if (now >= calibration_timestamp) calibration_begin_sampling();
+        return;
+    }
+    if (!calibration_sample_thumbstick() || !calibration_sample_imu()) {
+        calibration_restart();
+        return;
+    }
+    // Progress, one more LED lit every quarter.
+    uint32_t elapsed = now - calibration_timestamp;
+    uint32_t quarter = CFG_CALIBRATION_DURATION * 1000 / 4;
+    uint8_t masks[4] = {
+        LED_MASK_UP,
+        LED_MASK_UP | LED_MASK_RIGHT,
+        LED_MASK_UP | LED_MASK_RIGHT | LED_MASK_DOWN,
+        LED_MASK_UP | LED_MASK_RIGHT | LED_MASK_DOWN | LED_MASK_LEFT,
+    };
+    led_mask(masks[min(3, elapsed / quarter)]);
+    if (elapsed >= CFG_CALIBRATION_DURATION * 1000) calibration_finish();
+}
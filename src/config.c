@@ -15,6 +15,8 @@
 #include "touch.h"
 #include "profile.h"
 #include "helper.h"
+#include "tick.h"
+#include "rumble.h"
 
 uint8_t config_tune_mode = 0;
 uint8_t pcb_gen = 255;
@@ -38,6 +40,7 @@ void config_write_init() {
         .deadzone = 0,
         .touch_threshold = 0,
         .vibration = 0,
+        .tick_rate = 0,
         .ts_offset_x = 0,
         .ts_offset_y = 0,
         .imu_0_offset_x = 0,
@@ -61,6 +64,7 @@ void config_print() {
     printf("  deadzone=%i\n", config.deadzone);
     printf("  touch_threshold=%i\n", config.touch_threshold);
     printf("  vibration=%i\n", config.vibration);
+    printf("  tick_rate=%i\n", config.tick_rate);
     printf("  ts_offset_x=%f\n", config.ts_offset_x);
     printf("  ts_offset_y=%f\n", config.ts_offset_y);
     printf("  imu_0_offset_x=%f\n", config.imu_0_offset_x);
@@ -84,17 +88,16 @@ uint8_t config_get_profile() {
     return config.profile;
 }
 
-void config_set_thumbstick_offset(float x, float y) {
-    config_nvm_t config;
-    config_read(&config);
-    config.ts_offset_x = x,
-    config.ts_offset_y = y,
-    config_write(&config);
-}
-
-void config_set_imu_offset(double ax, double ay, double az, double bx, double by, double bz) {
+// All the offsets in a single write, so they are never stored half updated.
+void config_set_calibration(
+    float tx, float ty,
+    double ax, double ay, double az,
+    double bx, double by, double bz
+) {
     config_nvm_t config;
     config_read(&config);
+    config.ts_offset_x = tx,
+    config.ts_offset_y = ty,
     config.imu_0_offset_x = ax,
     config.imu_0_offset_y = ay,
     config.imu_0_offset_z = az,
@@ -110,6 +113,17 @@ uint8_t config_get_os_mode() {
     return config.os_mode;
 }
 
+uint16_t config_get_tick_frequency() {
+    config_nvm_t config;
+    config_read(&config);
+    uint16_t frequencies[3] = {
+        CFG_TICK_FREQUENCY_0,
+        CFG_TICK_FREQUENCY_1,
+        CFG_TICK_FREQUENCY_2
+    };
+    return frequencies[config.tick_rate];
+}
+
 void config_tune_update_leds() {
     config_nvm_t config;
     config_read(&config);
@@ -143,6 +157,23 @@ void config_tune_update_leds() {
         if (config.touch_threshold == 3) led_blink_mask(LED_MASK_LEFT + LED_MASK_UP);
         if (config.touch_threshold == 4) led_blink_mask(LED_MASK_UP);
     }
+    if (config_tune_mode == PROC_TUNE_TICK_RATE) {
+        led_shape_all_off();
+        led_set(LED_UP, true);
+        led_set(LED_DOWN, true);
+        if (config.tick_rate == 0) led_blink_mask(LED_MASK_LEFT);
+        if (config.tick_rate == 1) led_blink_mask(LED_MASK_LEFT + LED_MASK_RIGHT);
+        if (config.tick_rate == 2) led_blink_mask(LED_MASK_RIGHT);
+    }
+    if (config_tune_mode == PROC_TUNE_VIBRATION) {
+        led_shape_all_off();
+        led_set(LED_LEFT, true);
+        led_set(LED_RIGHT, true);
+        if (config.vibration == 0) led_blink_mask(LED_MASK_UP);
+        if (config.vibration == 1) led_blink_mask(LED_MASK_UP + LED_MASK_DOWN);
+        if (config.vibration == 2) led_blink_mask(LED_MASK_DOWN);
+        if (config.vibration == 3) led_blink_mask(0);
+    }
 }
 
 void config_tune_set_mode(uint8_t mode) {
@@ -180,6 +211,20 @@ void config_tune(bool direction) {
         config_write(&config);
         touch_update_threshold();
     }
+    if (config_tune_mode == PROC_TUNE_TICK_RATE) {
+        config.tick_rate = limit_between(config.tick_rate + value, 0, 2);
+        config_write(&config);
+        printf("Tune: Tick rate set to preset %i\n", config.tick_rate);
+        tick_update_frequency();
+        imu_update_sensitivity();
+        touch_update_threshold();
+    }
+    if (config_tune_mode == PROC_TUNE_VIBRATION) {
+        config.vibration = limit_between(config.vibration + value, 0, 3);
+        config_write(&config);
+        printf("Tune: Vibration set to preset %i\n", config.vibration);
+        rumble_update_strength();
+    }
     config_tune_update_leds();
 }
 
@@ -191,23 +236,6 @@ void config_bootsel() {
     reset_usb_boot(0, 0);
 }
 
-void config_calibrate_execute(alarm_id_t alarm) {
-    cancel_alarm(alarm);
-    led_shape_all_off();
-    thumbstick_calibrate();
-    imu_calibrate();
-    led_shape_all_off();
-    profile_led_lock = false;
-    profile_update_leds();
-}
-
-void config_calibrate() {
-    profile_led_lock = true;
-    led_shape_all_off();
-    led_blink_mask(LED_MASK_LEFT | LED_MASK_RIGHT);
-    add_alarm_in_ms(5000, (alarm_callback_t)config_calibrate_execute, NULL, true);
-}
-
 void config_set_pcb_gen(uint8_t gen) {
     pcb_gen = gen;
 }
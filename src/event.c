@@ -0,0 +1,159 @@
+// SPDX-License-Identifier: GPL-2.0-only
+// Copyright (C) 2022, Input Labs Oy.
+
+// Timed event queue.
+// Delayed key presses and releases (macros, timed releases) are kept in a
+// fixed-capacity min-heap ordered by due time, and the events that are due
+// run from the main loop at the start of each tick. So delayed actions
+// never touch the HID state from interrupt context, any number of them can
+// overlap, and pending ones are dropped at once on profile reset.
+//
+// Interrupt handlers (alarms, GPIO) post their actions into a ring instead
+// of touching the HID state, and the main loop applies them in order at the
+// same point of the tick. The ring has many producers and one consumer: a
+// producer reserves its slot and fills it with interrupts masked (there are
+// no exclusive load/store instructions on the M0+), and publishes it by
+// advancing the write index, which only the consumer reads. Only core 0
+// posts.
+
+#include <stdio.h>
+#include <pico/stdlib.h>
+#include <hardware/sync.h>
+#include "event.h"
+#include "hid.h"
+#include "rotary.h"
+
+Event event_heap[EVENT_QUEUE_LEN];
+uint8_t event_len = 0;
+uint32_t event_seq = 0;
+uint32_t event_overflows = 0;
+
+Event event_ring[EVENT_RING_LEN];
+volatile uint32_t event_ring_write = 0;
+volatile uint32_t event_ring_read = 0;
+uint32_t event_ring_overflows = 0;
+
+// Whether event a runs before event b, time comparisons are wrap-safe.
+bool event_before(Event *a, Event *b) {
+    if (a->due != b->due) return (int32_t)(a->due - b->due) < 0;
+    return (int32_t)(a->seq - b->seq) < 0;
+}
+
+void event_swap(uint8_t i, uint8_t j) {
+    Event tmp = event_heap[i];
+    event_heap[i] = event_heap[j];
+    event_heap[j] = tmp;
+}
+
+void event_push(Event event) {
+    uint8_t i = event_len;
+    event_heap[i] = event;
+    event_len++;
+    while (i > 0) {
+        uint8_t parent = (i - 1) / 2;
+        if (!event_before(&event_heap[i], &event_heap[parent])) break;
+        event_swap(i, parent);
+        i = parent;
+    }
+}
+
+Event event_pop() {
+    Event top = event_heap[0];
+    event_len--;
+    event_heap[0] = event_heap[event_len];
+    uint8_t i = 0;
+    while (true) {
+        uint8_t left = i * 2 + 1;
+        uint8_t right = left + 1;
+        uint8_t first = i;
+        if (left < event_len && event_before(&event_heap[left], &event_heap[first])) {
+            first = left;
+        }
+        if (right < event_len && event_before(&event_heap[right], &event_heap[first])) {
+            first = right;
+        }
+        if (first == i) break;
+        event_swap(i, first);
+        i = first;
+    }
+    return top;
+}
+
+// Schedule an action delay milliseconds from now. Must be called from the
+// main loop, not from interrupts.
+void event_schedule(uint16_t delay, EventAction action, uint8_t key, uint8_t *keys) {
+    if (event_len == EVENT_QUEUE_LEN) {
+        event_overflows += 1;
+        printf("Event: queue full, action dropped\n");
+        return;
+    }
+    Event event = {
+        .due = time_us_32() + (uint32_t)delay * 1000,
+        .seq = event_seq++,
+        .action = action,
+        .key = key,
+        .keys = keys,
+    };
+    event_push(event);
+}
+
+// Post an action to be applied by the main loop on the next tick, safe to
+// call from interrupts.
+void event_post(EventAction action, uint8_t key, uint8_t *keys) {
+    uint32_t irq = save_and_disable_interrupts();
+    uint32_t write = event_ring_write;
+    if (write - event_ring_read == EVENT_RING_LEN) {
+        event_ring_overflows += 1;
+    } else {
+        event_ring[write & (EVENT_RING_LEN - 1)] = (Event){
+            .due = time_us_32(),
+            .action = action,
+            .key = key,
+            .keys = keys,
+        };
+        event_ring_write = write + 1;
+    }
+    restore_interrupts(irq);
+}
+
+void event_apply(Event *event) {
+    if (event->action == EVENT_PRESS) hid_press(event->key);
+    if (event->action == EVENT_RELEASE) hid_release(event->key);
+    if (event->action == EVENT_PRESS_MULTIPLE) hid_press_multiple(event->keys);
+    if (event->action == EVENT_RELEASE_MULTIPLE) hid_release_multiple(event->keys);
+    if (event->action == EVENT_ROTARY) rotary_increment((int8_t)event->key, event->due);
+}
+
+// Apply the posted actions, then every scheduled event that is due,
+// including any scheduled by them for now.
+void event_run() {
+    uint32_t write = event_ring_write;
+    while (event_ring_read != write) {
+        event_apply(&event_ring[event_ring_read & (EVENT_RING_LEN - 1)]);
+        event_ring_read += 1;
+    }
+    uint32_t now = time_us_32();
+    while (event_len > 0 && (int32_t)(event_heap[0].due - now) <= 0) {
+        Event event = event_pop();
+        event_apply(&event);
+    }
+}
+
+// Drop the scheduled events, posted ones are still applied.
+void event_cancel_all() {
+    event_len = 0;
+}
+
+void event_print_stats() {
+    printf("Event: pending=%u overflows=%lu\n", event_len, event_overflows);
+    printf(
+        "  posted=%lu overflows=%lu\n",
+        event_ring_write,
+        event_ring_overflows
+    );
+}
+
+void event_init() {
+    printf("INIT: Event queue\n");
+    event_cancel_all();
+}
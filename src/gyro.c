@@ -10,10 +10,16 @@
 #include "imu.h"
 #include "hid.h"
 #include "touch.h"
+#include "profiler.h"
 
 bool Gyro__is_engaged(Gyro *self) {
     if (self->pin == PIN_NONE) return false;
-    if (self->pin == PIN_TOUCH_IN) return touch_status();
+    if (self->pin == PIN_TOUCH_IN) {
+        PROFILER_START(PROFILER_TOUCH);
+        bool touched = touch_status();
+        PROFILER_STOP(PROFILER_TOUCH);
+        return touched;
+    }
     return self->engage_button.is_pressed(&(self->engage_button));
 }
 
@@ -29,7 +35,9 @@ void Gyro__report(Gyro *self) {
         return;
     }
     // Report.
+    PROFILER_START(PROFILER_IMU);
     vector_t imu_gyro = imu_read_gyro();
+    PROFILER_STOP(PROFILER_IMU);
     int16_t x = (int16_t)imu_gyro.x;
     int16_t y = (int16_t)imu_gyro.y;
     int16_t z = (int16_t)imu_gyro.z;
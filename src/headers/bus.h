@@ -3,6 +3,7 @@
 
 #pragma once
 
+#include <stdint.h>
 #include <stdbool.h>
 
 #define I2C_FREQ 400 * 1000  // Hz.
@@ -34,6 +35,8 @@ uint8_t bus_i2c_read_one(uint8_t device, uint8_t reg);
 uint16_t bus_i2c_read_two(uint8_t device, uint8_t reg);
 // IO expanders.
 void bus_i2c_io_cache_update();
+void bus_i2c_io_cache_set(uint16_t value_0, uint16_t value_1, uint32_t timestamp);
+uint32_t bus_i2c_io_cache_timestamp();
 bool bus_i2c_io_cache_read(uint8_t device_index, uint8_t bit_index);
 bool bus_i2c_io_read(uint8_t device_id, uint8_t bit_index);
 // SPI.
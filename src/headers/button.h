@@ -36,6 +36,7 @@ struct Button_struct {
     bool state;
     bool state_secondary;
     bool virtual_press;
+    bool raw_state;
     uint64_t press_timestamp;
     uint64_t hold_timestamp;
 };
@@ -0,0 +1,14 @@
+// SPDX-License-Identifier: GPL-2.0-only
+// Copyright (C) 2022, Input Labs Oy.
+
+#pragma once
+#include <stdbool.h>
+
+typedef enum CalibrationState_enum {
+    CALIBRATION_IDLE,
+    CALIBRATION_WAIT,  // Giving time to leave the controller still.
+    CALIBRATION_SAMPLE,
+} CalibrationState;
+
+void calibration_start();
+void calibration_run();
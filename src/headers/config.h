@@ -13,14 +13,30 @@
 #define OS_MODE_XINPUT_UNIX 1
 #define OS_MODE_GENERIC 2
 
-#define CFG_STRUCT_VERSION 9
+#define CFG_STRUCT_VERSION 10
 #define CFG_LOG_LEVEL 0
 #define CFG_LED_BRIGHTNESS 0.2
 
-#define CFG_TICK_FREQUENCY 250  // Hz.
-#define CFG_HID_REPORT_PRIORITY_RATIO 8
+#define CFG_TICK_FREQUENCY_BASE 250  // Hz, reference for values expressed in ticks.
+#define CFG_TICK_FREQUENCY_0 250  // Hz.
+#define CFG_TICK_FREQUENCY_1 500  // Hz.
+#define CFG_TICK_FREQUENCY_2 1000  // Hz.
+#define CFG_DUAL_CORE 0  // Sensor acquisition on core 1.
+#define CFG_TICK_SOF_SYNC 0  // Align ticks to USB start-of-frame.
+#define CFG_TICK_SOF_LEAD 1500  // Microseconds from tick start to SOF.
+#define CFG_TICK_SOF_GUARD 50  // Microseconds of SOF search window.
+#define CFG_PROFILER 0  // Per-stage execution time histograms.
+#define CFG_LATENCY_TRACE 0  // Button edge to USB report latency.
+#define CFG_IDLE_TIMEOUT 0  // Seconds without input before idle, 0 disables. Adds up to a heartbeat of press latency.
+#define CFG_IDLE_HEARTBEAT 10  // Milliseconds between ticks while idle.
+#define CFG_HID_KEYBOARD_NKRO 1  // Bitmap keyboard report, otherwise 6KRO.
+#define CFG_HID_MOUSE_16BIT 1  // 16-bit mouse X/Y, otherwise 8-bit.
+#define CFG_HID_WHEEL_MULTIPLIER 8  // Wheel units per detent in high-resolution mode (16-bit mouse only).
+#define CFG_HID_GAMEPAD_16BIT 1  // 16-bit gamepad sticks, otherwise 8-bit.
+#define CFG_HID_SEPARATE_INTERFACES 0  // One HID interface and endpoint per class.
+#define CFG_MACRO_INTERVAL 10  // Milliseconds between macro key presses and releases.
 
-#define CFG_IMU_TICK_SAMPLES 128
+#define CFG_IMU_TICK_SAMPLES 128  // At base tick frequency.
 #define CFG_IMU_CALIBRATION_SAMPLES 50000
 
 #define CFG_GYRO_SENSITIVITY  pow(2, -9) * 1.45
@@ -31,6 +47,8 @@
 #define CFG_GYRO_SENSITIVITY_MULTIPLIER_MID 4.0 / 3.0
 #define CFG_GYRO_SENSITIVITY_MULTIPLIER_HIGH 2.0
 #define CFG_MOUSE_WHEEL_DEBOUNCE 1000
+#define CFG_MOUSE_WHEEL_ACCEL_INTERVAL 40000  // Microseconds between detents below which scrolling speeds up.
+#define CFG_MOUSE_WHEEL_ACCEL_MAX 4  // Wheel speed multiplier as the interval approaches zero.
 
 #define CFG_PRESS_DEBOUNCE 50  // Milliseconds.
 #define CFG_HOLD_EXCLUSIVE_TIME 200  // Milliseconds.
@@ -43,9 +61,24 @@
 #define CFG_THUMBSTICK_DEADZONE_HIGH 0.15
 #define CFG_THUMBSTICK_SATURATION 1.8
 #define CFG_THUMBSTICK_INNER_RADIUS 0.75
+#define CFG_THUMBSTICK_ADC_DMA 1  // Free-running ADC averaged per tick, otherwise one read per tick.
+#define CFG_THUMBSTICK_ADC_RATE 32000  // Samples per second, over both axes.
+
+#define CFG_CALIBRATION_DELAY 5000  // Milliseconds to leave the controller still.
+#define CFG_CALIBRATION_RESTART_DELAY 2000  // Milliseconds, after motion was detected.
+#define CFG_CALIBRATION_DURATION 4000  // Milliseconds of sampling.
+#define CFG_CALIBRATION_TICK_SAMPLES 32  // Per gyro and tick, at base tick frequency.
+#define CFG_CALIBRATION_RESTARTS 3  // Before giving up.
+#define CFG_CALIBRATION_GYRO_MOTION 100  // Gyro bits from the mean.
+#define CFG_CALIBRATION_THUMBSTICK_MOTION 0.05  // Axis deviation from the mean.
 
 #define CFG_DHAT_DEBOUNCE_TIME 100  // Milliseconds.
 
+#define CFG_VIBRATION_0 100  // Percent of rumble strength.
+#define CFG_VIBRATION_1 66
+#define CFG_VIBRATION_2 33
+#define CFG_VIBRATION_3 0
+
 typedef struct {
     uint8_t header;
     uint8_t config_version;
@@ -55,6 +88,7 @@ typedef struct {
     int8_t deadzone;
     int8_t touch_threshold;
     int8_t vibration;
+    int8_t tick_rate;
     float ts_offset_x;
     float ts_offset_y;
     double imu_0_offset_x;
@@ -70,12 +104,15 @@ void config_init();
 void config_read(config_nvm_t* config);
 void config_set_profile(uint8_t profile);
 uint8_t config_get_profile();
-void config_set_thumbstick_offset(float x, float y);
-void config_set_imu_offset(double ax, double ay, double az, double bx, double by, double bz);
+void config_set_calibration(
+    float tx, float ty,
+    double ax, double ay, double az,
+    double bx, double by, double bz
+);
 uint8_t config_get_os_mode();
+uint16_t config_get_tick_frequency();
 void config_tune_set_mode(uint8_t mode);
 void config_tune(bool direction);
-void config_calibrate();
 void config_reboot();
 void config_bootsel();
 void config_write_init();
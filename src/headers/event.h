@@ -0,0 +1,31 @@
+// SPDX-License-Identifier: GPL-2.0-only
+// Copyright (C) 2022, Input Labs Oy.
+
+#pragma once
+#include <stdint.h>
+
+#define EVENT_QUEUE_LEN 64
+#define EVENT_RING_LEN 32  // Must be a power of 2.
+
+typedef enum EventAction_enum {
+    EVENT_PRESS,
+    EVENT_RELEASE,
+    EVENT_PRESS_MULTIPLE,
+    EVENT_RELEASE_MULTIPLE,
+    EVENT_ROTARY,  // Key is the rotary increment.
+} EventAction;
+
+typedef struct Event_struct {
+    uint32_t due;  // Microseconds, wraps around. Posting time if posted.
+    uint32_t seq;  // Keeps insertion order among events due at once.
+    uint8_t action;
+    uint8_t key;
+    uint8_t *keys;
+} Event;
+
+void event_init();
+void event_schedule(uint16_t delay, EventAction action, uint8_t key, uint8_t *keys);
+void event_post(EventAction action, uint8_t key, uint8_t *keys);
+void event_run();
+void event_cancel_all();
+void event_print_stats();
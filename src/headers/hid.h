@@ -200,9 +200,67 @@
 #define PROC_THANKS                PROC_INDEX + 22
 #define PROC_MACRO                 PROC_INDEX + 23
 #define PROC_HOME_GAMEPAD          PROC_INDEX + 24
+#define PROC_TUNE_TICK_RATE        PROC_INDEX + 25
+
+// Report classes, in the same order as the latency trace classes.
+#define HID_KEYBOARD 0
+#define HID_MOUSE    1
+#define HID_GAMEPAD  2
+#define HID_CLASSES  3
+
+// Last-sent report cache, one per HID class plus XInput.
+#define HID_CACHE_XINPUT HID_CLASSES
+#define HID_CACHE_TYPES (HID_CLASSES + 1)
+#define HID_CACHE_SIZE 32
+
+#define HID_DIRTY_KEYBOARD (1 << HID_KEYBOARD)
+#define HID_DIRTY_MOUSE    (1 << HID_MOUSE)
+#define HID_DIRTY_GAMEPAD  (1 << HID_GAMEPAD)
+
+// Keys held by more than one binding at once, beyond that the extra
+// holders are not tracked, and the first release clears the key.
+#define HID_HOLDERS_MAX 16
+
+typedef struct Hid_holder_struct {
+    uint8_t key;
+    uint8_t extra;  // Holders beyond the first.
+} Hid_holder;
+
+typedef struct __attribute__((packed)) {
+    uint8_t buttons;
+    int16_t x;
+    int16_t y;
+    int8_t wheel;
+    int8_t pan;
+} hid_mouse_16bit_report;
+
+typedef struct __attribute__((packed)) {
+    int16_t x;
+    int16_t y;
+    int16_t z;
+    int16_t rz;
+    uint8_t rx;
+    uint8_t ry;
+    uint16_t buttons;
+} hid_gamepad_16bit_report;
+
+typedef struct hid_stats {
+    uint32_t sent;
+    uint32_t coalesced;  // State changes merged into an already pending report.
+    uint32_t deferred;   // Ticks that ended with the report still pending.
+    uint32_t skipped;    // Reports identical to the last one, not sent.
+    uint32_t skipped_bytes;
+    uint32_t holder_overflows;  // Extra holders lost to HID_HOLDERS_MAX.
+} hid_stats_t;
 
 void hid_thanks();
 void hid_matrix_reset();
+void hid_resync();
+bool hid_is_pending();
+void hid_report_drain();
+void hid_print_stats();
+void hid_reset_stats();
+bool hid_is_pressed(uint8_t key);
 void hid_press(uint8_t key);
 void hid_release(uint8_t key);
 void hid_press_multiple(uint8_t *keys);
@@ -211,13 +269,12 @@ void hid_press_later(uint8_t key, uint16_t delay);
 void hid_release_later(uint8_t key, uint16_t delay);
 void hid_press_multiple_later(uint8_t *keys, uint16_t delay);
 void hid_release_multiple_later(uint8_t *keys, uint16_t delay);
-void hid_press_later_callback(alarm_id_t alarm, uint8_t key);
-void hid_release_later_callback(alarm_id_t alarm, uint8_t key);
-void hid_press_multiple_later_callback(alarm_id_t alarm, uint8_t *keys);
-void hid_release_multiple_later_callback(alarm_id_t alarm, uint8_t *keys);
 bool hid_is_axis(uint8_t key);
 void hid_mouse_move(int16_t x, int16_t y);
-void hid_mouse_wheel(int8_t z);
+void hid_mouse_wheel(int16_t z);
+void hid_set_wheel_hires(bool enabled);
+uint16_t hid_get_feature(uint8_t instance, uint8_t report_id, uint8_t *buffer, uint16_t len);
+void hid_set_feature(uint8_t instance, uint8_t report_id, uint8_t const *buffer, uint16_t len);
 void hid_gamepad_lx(int16_t value);
 void hid_gamepad_ly(int16_t value);
 void hid_gamepad_lz(int16_t value);
@@ -2,6 +2,7 @@
 // Copyright (C) 2022, Input Labs Oy.
 
 #pragma once
+#include <stdint.h>
 
 // LSM6DSR
 #define IMU_CTRL2_G 0x11
@@ -21,7 +22,9 @@ typedef struct vector {
 } vector_t;
 
 void imu_init();
+vector_t imu_read_gyros();
 vector_t imu_read_gyro();
-void imu_calibrate();
+void imu_update_offsets();
+void imu_read_gyro_raw(uint8_t cs, int16_t *axes);
 void imu_update_sensitivity();
 
@@ -25,6 +25,7 @@
 #define PIN_SPI_CS1 19
 #define PIN_TX 27
 #define PIN_TY 26
+#define PIN_RUMBLE PIN_NONE  // PWM output to a rumble motor driver.
 
 // IO EXPANSION 1.
 #define PIN_GROUP_IO_0 100
@@ -62,6 +62,7 @@ void profile_report_active();
 void profile_set_home(bool state);
 void profile_set_home_gamepad(bool state);
 void profile_set_active(uint8_t index);
+void profile_reset_all();
 void profile_set_lock_leds(bool lock);
 void profile_update_leds();
 void profile_enable_all(bool value);
@@ -0,0 +1,45 @@
+// SPDX-License-Identifier: GPL-2.0-only
+// Copyright (C) 2022, Input Labs Oy.
+
+#pragma once
+#include <stdint.h>
+#include "config.h"
+
+// Histogram buckets are logarithmic, 4 per octave, covering the 24-bit
+// SysTick range.
+#define PROFILER_BUCKETS 96
+
+#if CFG_PROFILER
+    #define PROFILER_START(stage) profiler_start(stage)
+    #define PROFILER_STOP(stage) profiler_stop(stage)
+#else
+    #define PROFILER_START(stage)
+    #define PROFILER_STOP(stage)
+#endif
+
+typedef enum ProfilerStage_enum {
+    PROFILER_TICK,
+    PROFILER_IO,
+    PROFILER_BUTTONS,
+    PROFILER_THUMBSTICK,
+    PROFILER_GYRO,
+    PROFILER_IMU,
+    PROFILER_TOUCH,
+    PROFILER_HID,
+    PROFILER_TUD_TASK,
+    PROFILER_STAGES,
+} ProfilerStage;
+
+typedef struct ProfilerHistogram_struct {
+    uint32_t count;
+    uint64_t sum;
+    uint32_t min;
+    uint32_t max;
+    uint32_t buckets[PROFILER_BUCKETS];
+} ProfilerHistogram;
+
+void profiler_init();
+void profiler_start(ProfilerStage stage);
+void profiler_stop(ProfilerStage stage);
+void profiler_print();
+void profiler_reset();
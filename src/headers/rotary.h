@@ -9,8 +9,9 @@ struct Rotary_struct {
     void (*report) (Rotary *self);
     void (*reset) (Rotary *self);
     bool pending;
-    int8_t increment;
-    uint32_t timestamp;
+    int8_t increment;  // Detents accumulated since the last report.
+    uint32_t timestamp;  // Last detent.
+    uint32_t timestamp_reported;  // Last detent of the previous report.
     uint8_t actions_up[4];
     uint8_t actions_down[4];
 };
@@ -21,3 +22,4 @@ Rotary Rotary_ (
 );
 
 void rotary_init();
+void rotary_increment(int8_t increment, uint32_t timestamp);
@@ -0,0 +1,8 @@
+// SPDX-License-Identifier: GPL-2.0-only
+// Copyright (C) 2022, Input Labs Oy.
+
+#pragma once
+
+void rumble_init();
+void rumble_set(uint8_t left, uint8_t right);
+void rumble_update_strength();
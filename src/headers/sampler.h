@@ -0,0 +1,25 @@
+// SPDX-License-Identifier: GPL-2.0-only
+// Copyright (C) 2022, Input Labs Oy.
+
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include "imu.h"
+
+#define SAMPLER_RING_LEN 8  // Must be a power of 2.
+
+typedef struct sample {
+    uint32_t timestamp;
+    uint16_t io_0;
+    uint16_t io_1;
+    uint16_t adc[2];
+    vector_t gyro;
+    uint32_t touch_elapsed;
+} sample_t;
+
+void sampler_init();
+bool sampler_is_running();
+void sampler_pause(bool pause);
+void sampler_pull();
+sample_t* sampler_get();
+uint32_t sampler_get_overflows();
@@ -7,7 +7,21 @@
 #define ANALOG_FACTOR 32767
 #define TRIGGER_FACTOR 255
 #define DEADZONE_FROM_CONFIG -1
+#define THUMBSTICK_ONE 32768  // Q15.
+#define THUMBSTICK_Q15(value)  ((int32_t)((value) * THUMBSTICK_ONE))
+#define THUMBSTICK_TAN_22_5 13573  // Q15.
+#define THUMBSTICK_ADC_RING_BITS 9  // Ring size in bytes, as a power of 2.
+#define THUMBSTICK_ADC_RING_LEN ((1 << THUMBSTICK_ADC_RING_BITS) / sizeof(uint16_t))
+#define THUMBSTICK_SATURATION_Q16  ((int32_t)(CFG_THUMBSTICK_SATURATION * 65536))
+#define THUMBSTICK_CURVE_BITS 8  // Segments of the response curve, as a power of 2.
+#define THUMBSTICK_CURVE_LEN ((1 << THUMBSTICK_CURVE_BITS) + 1)
 #define GLYPH(...)  __VA_ARGS__, SENTINEL
+// Curve type and its parameters, as an array of doubles and its length, so
+// integer parameters are converted too. The leading 0 allows no parameters.
+#define CURVE(curve, ...)  \
+    curve, \
+    (const double[]){0, __VA_ARGS__} + 1, \
+    sizeof((const double[]){0, __VA_ARGS__}) / sizeof(double) - 1
 
 typedef enum ThumbstickMode_enum {
     THUMBSTICK_MODE_OFF,
@@ -15,11 +29,19 @@ typedef enum ThumbstickMode_enum {
     THUMBSTICK_MODE_ALPHANUMERIC,
 } ThumbstickMode;
 
+// Response curves, without parameters they are linear.
+typedef enum ThumbstickCurve_enum {
+    CURVE_LINEAR,
+    CURVE_EXPONENTIAL,  // Exponent.
+    CURVE_S,  // Steepness, 1 being linear.
+    CURVE_POINTS,  // Pairs of input and output, ascending, corners are exact on table entries.
+} ThumbstickCurve;
+
+// Q15.
 typedef struct ThumbstickPosition_struct {
-    float x;
-    float y;
-    float angle;
-    float radius;
+    int32_t x;
+    int32_t y;
+    int32_t radius;
 } ThumbstickPosition;
 
 typedef enum Dir4_enum {
@@ -30,6 +52,11 @@ typedef enum Dir4_enum {
     DIR4_DOWN,
 } Dir4;
 
+#define DIR4_MASK_LEFT (1 << DIR4_LEFT)
+#define DIR4_MASK_RIGHT (1 << DIR4_RIGHT)
+#define DIR4_MASK_UP (1 << DIR4_UP)
+#define DIR4_MASK_DOWN (1 << DIR4_DOWN)
+
 typedef enum Dir8_enum {
     DIR8_CENTER,
     DIR8_LEFT,
@@ -45,16 +72,24 @@ typedef enum Dir8_enum {
 typedef struct Thumbstick_struct Thumbstick;
 struct Thumbstick_struct {
     void (*report) (Thumbstick *self);
-    void (*report_4dir) (Thumbstick *self, ThumbstickPosition pos, float deadzone);
+    void (*report_4dir) (Thumbstick *self, ThumbstickPosition pos, int32_t deadzone);
     void (*report_alphanumeric) (Thumbstick *self, ThumbstickPosition pos);
     void (*reset) (Thumbstick *self);
     void (*config_glyphstick) (Thumbstick *self, ...);
     void (*report_glyphstick) (Thumbstick *self, uint8_t len, Dir4 *input);
     void (*config_daisywheel) (Thumbstick *self, ...);
     void (*report_daisywheel) (Thumbstick *self, Dir8 dir);
+    void (*config_curve) (
+        Thumbstick *self,
+        float anti_deadzone,
+        ThumbstickCurve curve,
+        const double *params,
+        uint8_t len
+    );
     ThumbstickMode mode;
-    float deadzone;
-    float overlap;
+    int32_t deadzone;  // Q15.
+    int32_t overlap_sin;  // Q15, of the sector cut.
+    int32_t overlap_cos;
     Button left;
     Button right;
     Button up;
@@ -65,6 +100,7 @@ struct Thumbstick_struct {
     uint8_t glyphstick_glyphs[64][8];
     uint8_t glyphstick_actions[64][4];
     uint8_t daisywheel[8][4][4];
+    uint16_t curve[THUMBSTICK_CURVE_LEN];  // Q15 radius, on the input radius.
 };
 
 Thumbstick Thumbstick_ (
@@ -81,6 +117,23 @@ Thumbstick Thumbstick_ (
 );
 
 void thumbstick_init();
+uint16_t thumbstick_adc_raw(uint8_t adc_index);
+void thumbstick_adc_update();
 void thumbstick_report();
-void thumbstick_calibrate();
 void thumbstick_update_deadzone();
+void thumbstick_update_offsets();
+int32_t thumbstick_adc(uint8_t adc_index, int32_t offset);
+int32_t thumbstick_axis(uint16_t raw, int32_t offset);
+uint32_t thumbstick_isqrt(uint32_t value);
+ThumbstickPosition thumbstick_position(int32_t x, int32_t y, int32_t deadzone);
+uint8_t thumbstick_dir4_mask(int32_t x, int32_t y, int32_t cut_sin, int32_t cut_cos);
+Dir4 thumbstick_dir4(int32_t x, int32_t y);
+Dir8 thumbstick_dir8(int32_t x, int32_t y);
+void thumbstick_curve_build(
+    uint16_t *lut,
+    ThumbstickCurve curve,
+    float anti_deadzone,
+    const double *params,
+    uint8_t len
+);
+int32_t thumbstick_curve(uint16_t *lut, int32_t radius);
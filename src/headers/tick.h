@@ -0,0 +1,35 @@
+// SPDX-License-Identifier: GPL-2.0-only
+// Copyright (C) 2022, Input Labs Oy.
+
+#pragma once
+#include <stdint.h>
+
+typedef struct tick_stats {
+    uint32_t ticks;
+    uint32_t overruns;
+    uint32_t skipped;
+    uint64_t jitter_sum;
+    uint32_t jitter_max;
+    uint64_t compute_sum;
+    uint32_t compute_max;
+    uint32_t idle_entries;
+    uint32_t idle_wakes;
+    uint32_t sof_locks;
+    uint32_t sof_lost;
+    uint32_t sof_late;
+    uint32_t sof_frames;
+    uint64_t sof_age_sum;
+    uint32_t sof_age_max;
+} tick_stats_t;
+
+void tick_init();
+void tick_activity();
+void tick_wake();
+void tick_wait();
+void tick_completed();
+uint16_t tick_get_frequency();
+void tick_update_frequency();
+uint32_t tick_get_count();
+tick_stats_t* tick_get_stats();
+void tick_print_stats();
+void tick_reset_stats();
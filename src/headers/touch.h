@@ -38,4 +38,5 @@
 
 void touch_init();
 void touch_update_threshold();
+uint32_t touch_get_elapsed();
 bool touch_status();
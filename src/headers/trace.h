@@ -0,0 +1,23 @@
+// SPDX-License-Identifier: GPL-2.0-only
+// Copyright (C) 2022, Input Labs Oy.
+
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+
+#define TRACE_SAMPLES 256  // Per class, must be a power of 2.
+
+typedef enum TraceClass_enum {
+    TRACE_KEYBOARD,
+    TRACE_MOUSE,
+    TRACE_GAMEPAD,
+    TRACE_CLASSES,
+} TraceClass;
+
+void trace_edge(bool *state, bool pressed, uint32_t timestamp);
+void trace_edge_clear();
+void trace_key(uint8_t key);
+void trace_commit(TraceClass class);
+void trace_discard(TraceClass class);
+void trace_print();
+void trace_reset();
@@ -2,6 +2,7 @@
 // Copyright (C) 2022, Input Labs Oy.
 
 #pragma once
+#include "config.h"
 
 #define BOARD_DEVICE_RHPORT_NUM 0
 #define BOARD_DEVICE_RHPORT_SPEED  OPT_MODE_FULL_SPEED
@@ -12,7 +13,12 @@
 #define CFG_TUSB_MEM_ALIGN __attribute__ ((aligned(4)))
 #define CFG_TUD_ENDPOINT0_SIZE 64
 
-#define CFG_TUD_HID 1
+#if CFG_HID_SEPARATE_INTERFACES
+    #define CFG_TUD_HID 3
+#else
+    #define CFG_TUD_HID 1
+#endif
+#define CFG_TUD_HID_EP_BUFSIZE 32
 #define CFG_TUD_CDC 0
 #define CFG_TUD_MSC 0
 #define CFG_TUD_MIDI 0
@@ -22,6 +28,22 @@
 #define REPORT_MOUSE 2
 #define REPORT_GAMEPAD 3
 
+// Interfaces, the XInput one comes after the HID ones.
+#define ITF_KEYBOARD 0
+#define ITF_MOUSE 1
+#define ITF_GAMEPAD 2
+#if CFG_HID_SEPARATE_INTERFACES
+    #define ITF_XINPUT 2
+#else
+    #define ITF_XINPUT 1
+#endif
+
+#define EP_HID_KEYBOARD 0x86
+#define EP_HID_MOUSE 0x87
+#define EP_HID_GAMEPAD 0x88
+
+#define KEYBOARD_NKRO_KEYS 120  // Keycodes 0 to 119, multiple of 8.
+
 #define STRING_VENDOR "Input Labs"
 #define STRING_PRODUCT "Alpakka"
 #define STRING_DEVICE_VERSION "1.0"
@@ -69,7 +91,7 @@
 #define DESCRIPTOR_INTERFACE_XINPUT \
     0x09,        /* bLength */\
     0x04,        /* bDescriptorType: interface */\
-    0x01,        /* bInterfaceNumber */\
+    ITF_XINPUT,  /* bInterfaceNumber */\
     0x00,        /* bAlternateSetting */\
     0x02,        /* bNumEndpoints */\
     0xFF,        /* bInterfaceClass */\
@@ -99,13 +121,13 @@
     0x20, 0x00,  /* wMaxPacketSize */\
     0x08         /* bInterval */
 
-#define DESCRIPTOR_INTERFACE_HID(report_size) \
+#define DESCRIPTOR_INTERFACE_HID(itf, protocol, report_size, ep) \
     TUD_HID_DESCRIPTOR( \
-        0,                      /* Interface index */\
+        itf,                    /* Interface index */\
         4,                      /* String index */\
-        HID_ITF_PROTOCOL_NONE,  /* Boot protocol */\
+        protocol,               /* Boot protocol */\
         report_size,            /* Report descriptor length */\
-        0x86,                   /* Interface address */\
+        ep,                     /* Interface address */\
         32,                     /* Endpoint buffer size */\
         1                       /* Interface interval (ms) */\
     )
@@ -127,7 +149,7 @@
     0x01,                    /* Sections */\
     0x00, 0x00, 0x00, 0x00,  /* Reserved */\
     0x00, 0x00, 0x00,        /* Reserved */\
-    0x01,                    /* Xinput interface index */\
+    ITF_XINPUT,              /* Xinput interface index */\
     0x01,                    /* Reserved */\
     0x58, 0x55, 0x53, 0x42,  /* Compat ID: XUSB10__ */\
     0x31, 0x30, 0x00, 0x00,  /* ... */\
@@ -135,3 +157,136 @@
     0x00, 0x00, 0x00, 0x00,  /* ... */\
     0x00, 0x00, 0x00, 0x00,  /* Reserved */\
     0x00, 0x00               /* Reserved */
+
+// Keyboard with a modifiers byte followed by one bit per keycode, so any
+// number of keys can be held at once.
+#define TUD_HID_REPORT_DESC_KEYBOARD_NKRO(...) \
+    HID_USAGE_PAGE   (HID_USAGE_PAGE_DESKTOP),\
+    HID_USAGE        (HID_USAGE_DESKTOP_KEYBOARD),\
+    HID_COLLECTION   (HID_COLLECTION_APPLICATION),\
+        __VA_ARGS__ \
+        /* Modifiers */\
+        HID_USAGE_PAGE   (HID_USAGE_PAGE_KEYBOARD),\
+        HID_USAGE_MIN    (224),\
+        HID_USAGE_MAX    (231),\
+        HID_LOGICAL_MIN  (0),\
+        HID_LOGICAL_MAX  (1),\
+        HID_REPORT_COUNT (8),\
+        HID_REPORT_SIZE  (1),\
+        HID_INPUT        (HID_DATA | HID_VARIABLE | HID_ABSOLUTE),\
+        /* Keycode bitmap */\
+        HID_USAGE_MIN    (0),\
+        HID_USAGE_MAX    (KEYBOARD_NKRO_KEYS - 1),\
+        HID_REPORT_COUNT (KEYBOARD_NKRO_KEYS),\
+        HID_REPORT_SIZE  (1),\
+        HID_INPUT        (HID_DATA | HID_VARIABLE | HID_ABSOLUTE),\
+        /* LEDs */\
+        HID_USAGE_PAGE   (HID_USAGE_PAGE_LED),\
+        HID_USAGE_MIN    (1),\
+        HID_USAGE_MAX    (5),\
+        HID_REPORT_COUNT (5),\
+        HID_REPORT_SIZE  (1),\
+        HID_OUTPUT       (HID_DATA | HID_VARIABLE | HID_ABSOLUTE),\
+        HID_REPORT_COUNT (1),\
+        HID_REPORT_SIZE  (3),\
+        HID_OUTPUT       (HID_CONSTANT),\
+    HID_COLLECTION_END
+
+// Mouse with 16-bit X/Y, so a whole tick of motion fits in one report
+// instead of being split in steps of 127.
+#define TUD_HID_REPORT_DESC_MOUSE_16BIT(...) \
+    HID_USAGE_PAGE   (HID_USAGE_PAGE_DESKTOP),\
+    HID_USAGE        (HID_USAGE_DESKTOP_MOUSE),\
+    HID_COLLECTION   (HID_COLLECTION_APPLICATION),\
+        __VA_ARGS__ \
+        HID_USAGE      (HID_USAGE_DESKTOP_POINTER),\
+        HID_COLLECTION (HID_COLLECTION_PHYSICAL),\
+            /* Buttons */\
+            HID_USAGE_PAGE   (HID_USAGE_PAGE_BUTTON),\
+            HID_USAGE_MIN    (1),\
+            HID_USAGE_MAX    (5),\
+            HID_LOGICAL_MIN  (0),\
+            HID_LOGICAL_MAX  (1),\
+            HID_REPORT_COUNT (5),\
+            HID_REPORT_SIZE  (1),\
+            HID_INPUT        (HID_DATA | HID_VARIABLE | HID_ABSOLUTE),\
+            HID_REPORT_COUNT (1),\
+            HID_REPORT_SIZE  (3),\
+            HID_INPUT        (HID_CONSTANT),\
+            /* X, Y */\
+            HID_USAGE_PAGE   (HID_USAGE_PAGE_DESKTOP),\
+            HID_USAGE        (HID_USAGE_DESKTOP_X),\
+            HID_USAGE        (HID_USAGE_DESKTOP_Y),\
+            HID_LOGICAL_MIN_N(-32767, 2),\
+            HID_LOGICAL_MAX_N(32767, 2),\
+            HID_REPORT_COUNT (2),\
+            HID_REPORT_SIZE  (16),\
+            HID_INPUT        (HID_DATA | HID_VARIABLE | HID_RELATIVE),\
+            /* Wheel, with resolution multiplier feature */\
+            HID_COLLECTION   (HID_COLLECTION_LOGICAL),\
+                HID_USAGE        (HID_USAGE_DESKTOP_RESOLUTION_MULTIPLIER),\
+                HID_LOGICAL_MIN  (0),\
+                HID_LOGICAL_MAX  (1),\
+                HID_PHYSICAL_MIN (1),\
+                HID_PHYSICAL_MAX (CFG_HID_WHEEL_MULTIPLIER),\
+                HID_REPORT_COUNT (1),\
+                HID_REPORT_SIZE  (2),\
+                HID_FEATURE      (HID_DATA | HID_VARIABLE | HID_ABSOLUTE),\
+                HID_REPORT_SIZE  (6),\
+                HID_FEATURE      (HID_CONSTANT),\
+                HID_PHYSICAL_MIN (0),\
+                HID_PHYSICAL_MAX (0),\
+                HID_USAGE        (HID_USAGE_DESKTOP_WHEEL),\
+                HID_LOGICAL_MIN  (0x81),\
+                HID_LOGICAL_MAX  (0x7f),\
+                HID_REPORT_SIZE  (8),\
+                HID_INPUT        (HID_DATA | HID_VARIABLE | HID_RELATIVE),\
+            HID_COLLECTION_END,\
+            /* Horizontal wheel */\
+            HID_USAGE_PAGE   (HID_USAGE_PAGE_CONSUMER),\
+            HID_USAGE_N      (HID_USAGE_CONSUMER_AC_PAN, 2),\
+            HID_LOGICAL_MIN  (0x81),\
+            HID_LOGICAL_MAX  (0x7f),\
+            HID_REPORT_COUNT (1),\
+            HID_REPORT_SIZE  (8),\
+            HID_INPUT        (HID_DATA | HID_VARIABLE | HID_RELATIVE),\
+        HID_COLLECTION_END,\
+    HID_COLLECTION_END
+
+// Gamepad with 16-bit sticks and 8-bit triggers, the same precision as
+// XInput. Sticks are X/Y and Z/Rz, triggers Rx/Ry, as in the 8-bit TinyUSB
+// gamepad.
+#define TUD_HID_REPORT_DESC_GAMEPAD_16BIT(...) \
+    HID_USAGE_PAGE   (HID_USAGE_PAGE_DESKTOP),\
+    HID_USAGE        (HID_USAGE_DESKTOP_GAMEPAD),\
+    HID_COLLECTION   (HID_COLLECTION_APPLICATION),\
+        __VA_ARGS__ \
+        /* Sticks */\
+        HID_USAGE_PAGE   (HID_USAGE_PAGE_DESKTOP),\
+        HID_USAGE        (HID_USAGE_DESKTOP_X),\
+        HID_USAGE        (HID_USAGE_DESKTOP_Y),\
+        HID_USAGE        (HID_USAGE_DESKTOP_Z),\
+        HID_USAGE        (HID_USAGE_DESKTOP_RZ),\
+        HID_LOGICAL_MIN_N(-32767, 2),\
+        HID_LOGICAL_MAX_N(32767, 2),\
+        HID_REPORT_COUNT (4),\
+        HID_REPORT_SIZE  (16),\
+        HID_INPUT        (HID_DATA | HID_VARIABLE | HID_ABSOLUTE),\
+        /* Triggers */\
+        HID_USAGE        (HID_USAGE_DESKTOP_RX),\
+        HID_USAGE        (HID_USAGE_DESKTOP_RY),\
+        HID_LOGICAL_MIN  (0),\
+        HID_LOGICAL_MAX_N(255, 2),\
+        HID_REPORT_COUNT (2),\
+        HID_REPORT_SIZE  (8),\
+        HID_INPUT        (HID_DATA | HID_VARIABLE | HID_ABSOLUTE),\
+        /* Buttons */\
+        HID_USAGE_PAGE   (HID_USAGE_PAGE_BUTTON),\
+        HID_USAGE_MIN    (1),\
+        HID_USAGE_MAX    (16),\
+        HID_LOGICAL_MIN  (0),\
+        HID_LOGICAL_MAX  (1),\
+        HID_REPORT_COUNT (16),\
+        HID_REPORT_SIZE  (1),\
+        HID_INPUT        (HID_DATA | HID_VARIABLE | HID_ABSOLUTE),\
+    HID_COLLECTION_END
@@ -4,6 +4,9 @@
 #pragma once
 
 #define XINPUT_REPORT_SIZE 20
+#define XINPUT_OUT_SIZE 32  // OUT endpoint max packet size.
+#define XINPUT_OUT_RUMBLE 0x00
+#define XINPUT_OUT_LED 0x01
 
 typedef struct {
     uint8_t report_id;
@@ -19,5 +22,6 @@ typedef struct {
     uint8_t reserved[6];
 } xinput_report;
 
-void xinput_send_report(xinput_report *report);
-void xinput_receive_report();
+xinput_report *xinput_report_buffer();
+bool xinput_send_report();
+bool xinput_receive_report();
@@ -2,23 +2,33 @@
 // Copyright (C) 2022, Input Labs Oy.
 
 #include <tusb.h>
+#include <hardware/sync.h>
 #include "config.h"
 #include "hid.h"
 #include "profile.h"
 #include "xinput.h"
 #include "helper.h"
+#include "profiler.h"
+#include "trace.h"
+#include "tick.h"
+#include "event.h"
+#include "calibration.h"
 #include "thanks.c"
 
 bool hid_allow_communication = true;  // Extern.
-bool synced_keyboard = false;
-bool synced_mouse = false;
-bool synced_gamepad = false;
-uint16_t alarms = 0;
-alarm_pool_t *alarm_pool;
 
-uint8_t state_matrix[256] = {0,};
+// Pressed state of every non-procedure key, one bit per key index, so the
+// report builders can read whole classes with a few word operations.
+// Keys held by more than one source (eg: the same key mapped to two buttons)
+// keep the extra holders in a small side-table instead of per-key counters.
+uint32_t state_pressed[8] = {0,};
+Hid_holder state_holders[HID_HOLDERS_MAX];
+uint8_t state_holders_len = 0;
+uint8_t state_dirty = 0;
 int16_t mouse_x = 0;
 int16_t mouse_y = 0;
+int16_t mouse_z = 0;  // In fractions of a detent, see CFG_HID_WHEEL_MULTIPLIER.
+bool mouse_wheel_hires = false;
 int16_t gamepad_lx = 0;
 int16_t gamepad_ly = 0;
 int16_t gamepad_lz = 0;
@@ -27,12 +37,131 @@ int16_t gamepad_ry = 0;
 int16_t gamepad_rz = 0;
 
 void hid_matrix_reset() {
-    for(uint8_t i=0; i<255; i++) {
-        state_matrix[i] = 0;
+    memset(state_pressed, 0, sizeof(state_pressed));
+    state_holders_len = 0;
+    mouse_z = 0;
+    hid_resync();
+}
+
+// Report scheduler.
+// A class with changed state is pending until its report is sent, further
+// changes in the meantime are coalesced into that same report. Pending
+// classes of the HID interface are queued in the order they changed and
+// drained while the endpoint is free, and each completed transfer chains
+// the next one, so a backlog goes out on consecutive USB frames instead of
+// one class per tick. The XInput gamepad has its own endpoint.
+uint8_t hid_queue[HID_CLASSES];
+uint8_t hid_queue_len = 0;
+hid_stats_t hid_stats[HID_CLASSES];
+
+// Last report sent of each type. A report identical to the previous one
+// carries no new information, so it is not transferred.
+uint8_t hid_cache[HID_CACHE_TYPES][HID_CACHE_SIZE];
+uint8_t hid_cache_len[HID_CACHE_TYPES] = {0,};
+
+// HID instance and report ID used by each class, report IDs are only needed
+// when all classes share one interface.
+#if CFG_HID_SEPARATE_INTERFACES
+    #define HID_INSTANCE(class) (class)
+    #define HID_ID(report_id) 0
+#else
+    #define HID_INSTANCE(class) 0
+    #define HID_ID(report_id) (report_id)
+#endif
+
+bool hid_is_xinput_class(uint8_t class) {
+    return class == HID_GAMEPAD && config_get_os_mode() != OS_MODE_GENERIC;
+}
+
+// Presses from interrupts and alarms go through the event ring, so this only
+// runs in the main loop. Masking interrupts around the queue is a cheap guard
+// against a future caller that does not.
+void hid_mark_dirty(uint8_t class) {
+    uint8_t mask = 1 << class;
+    uint32_t irq = save_and_disable_interrupts();
+    if (state_dirty & mask) {
+        hid_stats[class].coalesced += 1;
+    } else {
+        state_dirty |= mask;
+        if (!hid_is_xinput_class(class)) {
+            hid_queue[hid_queue_len] = class;
+            hid_queue_len++;
+        }
+    }
+    restore_interrupts(irq);
+}
+
+// Send all reports again on the next ticks.
+void hid_resync() {
+    memset(hid_cache_len, 0, sizeof(hid_cache_len));
+    state_dirty = 0;
+    hid_queue_len = 0;
+    for(uint8_t class=0; class<HID_CLASSES; class++) hid_mark_dirty(class);
+}
+
+bool hid_is_pending() {
+    return hid_allow_communication && hid_queue_len > 0;
+}
+
+bool hid_is_pressed(uint8_t key) {
+    return state_pressed[key >> 5] & (1 << (key & 31));
+}
+
+// Up to 16 consecutive key states starting at index, which must not span
+// more than two words.
+uint16_t hid_matrix_bits(uint8_t index, uint8_t len) {
+    uint8_t w = index >> 5;
+    uint8_t shift = index & 31;
+    uint32_t bits = state_pressed[w] >> shift;
+    if (shift + len > 32) bits |= state_pressed[w + 1] << (32 - shift);
+    return bits & ((1 << len) - 1);
+}
+
+uint8_t hid_key_class(uint8_t key) {
+    if (key >= GAMEPAD_INDEX) return HID_GAMEPAD;
+    if (key >= MOUSE_INDEX) return HID_MOUSE;
+    return HID_KEYBOARD;
+}
+
+int8_t hid_holder_find(uint8_t key) {
+    for(uint8_t i=0; i<state_holders_len; i++) {
+        if (state_holders[i].key == key) return i;
+    }
+    return -1;
+}
+
+void hid_matrix_press(uint8_t key) {
+    if (!hid_is_pressed(key)) {
+        state_pressed[key >> 5] |= (1 << (key & 31));
+        hid_mark_dirty(hid_key_class(key));
+        return;
+    }
+    // Already held, only the holder count changes.
+    int8_t i = hid_holder_find(key);
+    if (i >= 0) {
+        state_holders[i].extra += 1;
+    } else if (state_holders_len < HID_HOLDERS_MAX) {
+        state_holders[state_holders_len] = (Hid_holder){key, 1};
+        state_holders_len++;
+    } else {
+        // Counted only, printing here would block the main loop on stdio.
+        hid_stats[hid_key_class(key)].holder_overflows += 1;
     }
-    synced_keyboard = false;
-    synced_mouse = false;
-    synced_gamepad = false;
+}
+
+void hid_matrix_release(uint8_t key) {
+    int8_t i = hid_holder_find(key);
+    if (i >= 0) {
+        state_holders[i].extra -= 1;
+        if (state_holders[i].extra == 0) {
+            state_holders_len--;
+            state_holders[i] = state_holders[state_holders_len];
+        }
+        return;
+    }
+    if (!hid_is_pressed(key)) return;
+    state_pressed[key >> 5] &= ~(1 << (key & 31));
+    hid_mark_dirty(hid_key_class(key));
 }
 
 void hid_procedure_press(uint8_t procedure){
@@ -57,7 +186,8 @@ void hid_procedure_press(uint8_t procedure){
     if (procedure == PROC_TUNE_DEADZONE) config_tune_set_mode(procedure);
     if (procedure == PROC_TUNE_TOUCH_THRESHOLD) config_tune_set_mode(procedure);
     if (procedure == PROC_TUNE_VIBRATION) config_tune_set_mode(procedure);
-    if (procedure == PROC_CALIBRATE) config_calibrate();
+    if (procedure == PROC_TUNE_TICK_RATE) config_tune_set_mode(procedure);
+    if (procedure == PROC_CALIBRATE) calibration_start();
     if (procedure == PROC_BOOTSEL) config_bootsel();
     if (procedure == PROC_THANKS) hid_thanks();
 }
@@ -71,10 +201,11 @@ void hid_press(uint8_t key) {
     if (key == KEY_NONE) return;
     else if (key >= PROC_INDEX) hid_procedure_press(key);
     else {
-        state_matrix[key] += 1;
-        if (key >= GAMEPAD_INDEX) synced_gamepad = false;
-        else if (key >= MOUSE_INDEX) synced_mouse = false;
-        else synced_keyboard = false;
+        trace_key(key);
+        tick_activity();
+        if (key == MOUSE_SCROLL_UP) hid_mouse_wheel(CFG_HID_WHEEL_MULTIPLIER);
+        else if (key == MOUSE_SCROLL_DOWN) hid_mouse_wheel(-CFG_HID_WHEEL_MULTIPLIER);
+        else hid_matrix_press(key);
     }
 }
 
@@ -84,23 +215,21 @@ void hid_release(uint8_t key) {
     else if (key == MOUSE_SCROLL_DOWN) return;
     else if (key >= PROC_INDEX) hid_procedure_release(key);
     else {
-        state_matrix[key] -= 1;
-        if (key >= GAMEPAD_INDEX) synced_gamepad = false;
-        else if (key >= MOUSE_INDEX) synced_mouse = false;
-        else synced_keyboard = false;
+        trace_key(key);
+        tick_activity();
+        hid_matrix_release(key);
     }
 }
 
 void hid_press_multiple(uint8_t *keys) {
     if (keys[0] == PROC_MACRO) {
-        if (alarms > 0) return;  // Disallows parallel macros. TODO fix.
-        uint16_t time = 10;
+        uint16_t time = CFG_MACRO_INTERVAL;
         for(uint8_t i=1; i<MACROS_LEN; i++) {
             if (keys[i] == 0) break;
             hid_press_later(keys[i], time);
-            time += 10;
+            time += CFG_MACRO_INTERVAL;
             hid_release_later(keys[i], time);
-            time += 10;
+            time += CFG_MACRO_INTERVAL;
         }
     } else {
         for(uint8_t i=0; i<ACTIONS_LEN; i++) {
@@ -119,180 +248,239 @@ void hid_release_multiple(uint8_t *keys) {
 }
 
 void hid_press_later(uint8_t key, uint16_t delay) {
-    alarm_pool_add_alarm_in_ms(
-        alarm_pool,
-        delay,
-        (alarm_callback_t)hid_press_later_callback,
-        (void*)(uint32_t)key,
-        true
-    );
-    alarms++;
+    event_schedule(delay, EVENT_PRESS, key, NULL);
 }
 
 void hid_release_later(uint8_t key, uint16_t delay) {
-    alarm_pool_add_alarm_in_ms(
-        alarm_pool,
-        delay,
-        (alarm_callback_t)hid_release_later_callback,
-        (void*)(uint32_t)key,
-        true
-    );
-    alarms++;
+    event_schedule(delay, EVENT_RELEASE, key, NULL);
 }
 
 void hid_press_multiple_later(uint8_t *keys, uint16_t delay) {
-    alarm_pool_add_alarm_in_ms(
-        alarm_pool,
-        delay,
-        (alarm_callback_t)hid_press_multiple_later_callback,
-        keys,
-        true
-    );
-    alarms++;
+    event_schedule(delay, EVENT_PRESS_MULTIPLE, 0, keys);
 }
 
 void hid_release_multiple_later(uint8_t *keys, uint16_t delay) {
-    alarm_pool_add_alarm_in_ms(
-        alarm_pool,
-        delay,
-        (alarm_callback_t)hid_release_multiple_later_callback,
-        keys,
-        true
-    );
-    alarms++;
+    event_schedule(delay, EVENT_RELEASE_MULTIPLE, 0, keys);
 }
 
-void hid_press_later_callback(alarm_id_t alarm, uint8_t key) {
-    alarm_pool_cancel_alarm(alarm_pool, alarm);
-    hid_press(key);
-    alarms--;
+bool hid_is_axis(uint8_t key) {
+    return is_between(key, GAMEPAD_AXIS_INDEX, PROC_INDEX-1);
 }
 
-void hid_release_later_callback(alarm_id_t alarm, uint8_t key) {
-    alarm_pool_cancel_alarm(alarm_pool, alarm);
-    hid_release(key);
-    alarms--;
+void hid_mouse_move(int16_t x, int16_t y) {
+    if (x || y) tick_activity();
+    mouse_x += x;
+    mouse_y += y;
+    hid_mark_dirty(HID_MOUSE);
 }
 
-void hid_press_multiple_later_callback(alarm_id_t alarm, uint8_t *keys) {
-    alarm_pool_cancel_alarm(alarm_pool, alarm);
-    hid_press_multiple(keys);
-    alarms--;
+// Wheel movement in fractions of a detent.
+void hid_mouse_wheel(int16_t z) {
+    if (!z) return;
+    tick_activity();
+    mouse_z += z;
+    hid_mark_dirty(HID_MOUSE);
 }
 
-void hid_release_multiple_later_callback(alarm_id_t alarm, uint8_t *keys) {
-    alarm_pool_cancel_alarm(alarm_pool, alarm);
-    hid_release_multiple(keys);
-    alarms--;
+void hid_set_wheel_hires(bool enabled) {
+    if (enabled == mouse_wheel_hires) return;
+    printf("HID: Wheel high-resolution %s\n", enabled ? "enabled" : "disabled");
+    mouse_wheel_hires = enabled;
 }
 
-bool hid_is_axis(uint8_t key) {
-    return is_between(key, GAMEPAD_AXIS_INDEX, PROC_INDEX-1);
+// Feature reports, only the wheel resolution multiplier of the mouse.
+// TinyUSB passes the report ID through in the buffer when there is one.
+uint16_t hid_get_feature(uint8_t instance, uint8_t report_id, uint8_t *buffer, uint16_t len) {
+    if (instance != HID_INSTANCE(HID_MOUSE)) return 0;
+    if (report_id != HID_ID(REPORT_MOUSE)) return 0;
+    uint8_t size = report_id ? 2 : 1;
+    if (len < size) return 0;
+    if (report_id) buffer[0] = report_id;
+    buffer[size - 1] = mouse_wheel_hires;
+    return size;
 }
 
-void hid_mouse_move(int16_t x, int16_t y) {
-    mouse_x += x;
-    mouse_y += y;
-    synced_mouse = false;
+void hid_set_feature(uint8_t instance, uint8_t report_id, uint8_t const *buffer, uint16_t len) {
+    if (instance != HID_INSTANCE(HID_MOUSE)) return;
+    if (report_id != HID_ID(REPORT_MOUSE)) return;
+    if (report_id && len > 1 && buffer[0] == report_id) {
+        buffer += 1;
+        len -= 1;
+    }
+    if (len < 1) return;
+    hid_set_wheel_hires(buffer[0] & 0b11);
 }
 
 void hid_gamepad_lx(int16_t value) {
     if (value == gamepad_lx) return;
     gamepad_lx = value;
-    synced_gamepad = false;
+    hid_mark_dirty(HID_GAMEPAD);
+    tick_activity();
 }
 
 void hid_gamepad_ly(int16_t value) {
     if (value == gamepad_ly) return;
     gamepad_ly = value;
-    synced_gamepad = false;
+    hid_mark_dirty(HID_GAMEPAD);
+    tick_activity();
 }
 
 void hid_gamepad_lz(int16_t value) {
     if (value == gamepad_lz) return;
     gamepad_lz = value;
-    synced_gamepad = false;
+    hid_mark_dirty(HID_GAMEPAD);
+    tick_activity();
 }
 
 void hid_gamepad_rx(int16_t value) {
     if (value == gamepad_rx) return;
     gamepad_rx = value;
-    synced_gamepad = false;
+    hid_mark_dirty(HID_GAMEPAD);
+    tick_activity();
 }
 
 void hid_gamepad_ry(int16_t value) {
     if (value == gamepad_ry) return;
     gamepad_ry = value;
-    synced_gamepad = false;
+    hid_mark_dirty(HID_GAMEPAD);
+    tick_activity();
 }
 
 void hid_gamepad_rz(int16_t value) {
     if (value == gamepad_rz) return;
     gamepad_rz = value;
-    synced_gamepad = false;
+    hid_mark_dirty(HID_GAMEPAD);
+    tick_activity();
 }
 
-void hid_mouse_report() {
-    int8_t buttons = 0;
-    for(int i=0; i<5; i++) {
-        buttons += state_matrix[MOUSE_INDEX + i] << i;
+// Takes up to limit from the accumulated motion, the rest is carried into
+// the next report.
+int16_t hid_mouse_take(int16_t *value, int16_t limit) {
+    int16_t taken = limit_between(*value, -limit, limit);
+    *value -= taken;
+    return taken;
+}
+
+bool hid_cache_match(uint8_t type, void const *report, uint8_t len) {
+    return len == hid_cache_len[type] && !memcmp(hid_cache[type], report, len);
+}
+
+void hid_cache_store(uint8_t type, void const *report, uint8_t len) {
+    memcpy(hid_cache[type], report, len);
+    hid_cache_len[type] = len;
+}
+
+void hid_report_sent(uint8_t class) {
+    trace_commit((TraceClass)class);
+    hid_stats[class].sent += 1;
+}
+
+void hid_report_skipped(uint8_t class, uint8_t len) {
+    trace_discard((TraceClass)class);
+    hid_stats[class].skipped += 1;
+    hid_stats[class].skipped_bytes += len;
+}
+
+// Send a report on the HID interface of its class unless it is a repeat,
+// with force it is sent regardless (eg: relative motion). Returns false if
+// the report could not be queued, then it is neither cached nor counted.
+bool hid_send(
+    uint8_t class,
+    uint8_t report_id,
+    void const *report,
+    uint8_t len,
+    bool force
+) {
+    if (!force && hid_cache_match(class, report, len)) {
+        hid_report_skipped(class, len);
+        return true;
     }
-    int8_t report_x = 0;
-    int8_t report_y = 0;
-    if (mouse_x >= 127) {
-        report_x = 127;
-        mouse_x -= 127;
-    } else if (mouse_x <= -127) {
-        report_x = -127;
-        mouse_x += 127;
-    } else {
-        report_x = (int8_t)mouse_x;
-        mouse_x = 0;
+    if (!tud_hid_n_report(HID_INSTANCE(class), report_id, report, len)) return false;
+    hid_cache_store(class, report, len);
+    hid_report_sent(class);
+    return true;
+}
+
+// Hosts with high-resolution scrolling get the wheel in fractions of a
+// detent, others in whole detents with the remainder carried over.
+int8_t hid_mouse_take_wheel() {
+    if (mouse_wheel_hires) return hid_mouse_take(&mouse_z, 127);
+    int16_t detents = limit_between(mouse_z / CFG_HID_WHEEL_MULTIPLIER, -127, 127);
+    mouse_z -= detents * CFG_HID_WHEEL_MULTIPLIER;
+    return detents;
+}
+
+bool hid_mouse_report() {
+    uint8_t buttons = hid_matrix_bits(MOUSE_1, 5);
+    int8_t report_z = hid_mouse_take_wheel();
+    #if CFG_HID_MOUSE_16BIT
+        hid_mouse_16bit_report report = {
+            .buttons = buttons,
+            .x = hid_mouse_take(&mouse_x, 32767),
+            .y = hid_mouse_take(&mouse_y, 32767),
+            .wheel = report_z,
+            .pan = 0,
+        };
+        bool moved = report.x || report.y || report.wheel;
+        int16_t taken[3] = {report.x, report.y, report.wheel};
+    #else
+        int8_t report[5] = {
+            buttons,
+            hid_mouse_take(&mouse_x, 127),
+            hid_mouse_take(&mouse_y, 127),
+            report_z,
+            0
+        };
+        bool moved = report[1] || report[2] || report[3];
+        int16_t taken[3] = {report[1], report[2], report[3]};
+    #endif
+    // Motion is relative, a repeated non-zero move is still a move.
+    if (hid_send(HID_MOUSE, HID_ID(REPORT_MOUSE), &report, sizeof(report), moved)) {
+        return true;
     }
-    if (mouse_y >= 127) {
-        report_y = 127;
-        mouse_y -= 127;
-    } else if (mouse_y <= -127) {
-        report_y = -127;
-        mouse_y += 127;
-    } else {
-        report_y = (int8_t)mouse_y;
-        mouse_y = 0;
+    // Not sent, the motion is carried into the next report.
+    mouse_x += taken[0];
+    mouse_y += taken[1];
+    mouse_z += taken[2] * (mouse_wheel_hires ? 1 : CFG_HID_WHEEL_MULTIPLIER);
+    return false;
+}
+
+// Keyboard boot protocol is selected by hosts (eg: BIOS) that do not parse
+// report descriptors, the keyboard interface then only carries 6KRO keyboard
+// reports without report ID.
+bool hid_is_boot_protocol() {
+    return tud_hid_n_get_protocol(HID_INSTANCE(HID_KEYBOARD)) == HID_PROTOCOL_BOOT;
+}
+
+bool hid_keyboard_report_nkro() {
+    // The bitmap is the first bytes of the pressed state as is.
+    uint8_t report[1 + KEYBOARD_NKRO_KEYS/8];
+    report[0] = hid_matrix_bits(MODIFIER_INDEX, 8);
+    memcpy(&report[1], state_pressed, KEYBOARD_NKRO_KEYS/8);
+    return hid_send(HID_KEYBOARD, HID_ID(REPORT_KEYBOARD), report, sizeof(report), false);
+}
+
+bool hid_keyboard_report() {
+    bool boot = hid_is_boot_protocol();
+    if (CFG_HID_KEYBOARD_NKRO && !boot) {
+        return hid_keyboard_report_nkro();
     }
-    uint8_t mouse_z = state_matrix[MOUSE_SCROLL_UP] - state_matrix[MOUSE_SCROLL_DOWN];
-    state_matrix[MOUSE_SCROLL_UP] = 0;
-    state_matrix[MOUSE_SCROLL_DOWN] = 0;
-    tud_hid_mouse_report(
-        REPORT_MOUSE,
-        buttons,
-        report_x,
-        report_y,
-        mouse_z,
-        0
-    );
-}
-
-void hid_keyboard_report() {
-    uint8_t report[6] = {0};
+    // Modifiers, reserved byte and 6 keycodes.
+    uint8_t report[8] = {0};
+    report[0] = hid_matrix_bits(MODIFIER_INDEX, 8);
     uint8_t keys_available = 6;
-    for(int i=0; i<=115; i++) {
-        if (state_matrix[i] >= 1) {
-            report[keys_available - 1] = (uint8_t)i;
+    for(uint8_t w=0; w<4 && keys_available>0; w++) {
+        uint32_t word = state_pressed[w];
+        if (w == 3) word &= 0x000FFFFF;  // Keys 96 to 115.
+        while (word && keys_available>0) {
+            uint8_t bit = __builtin_ctz(word);
+            word &= word - 1;
+            report[2 + keys_available - 1] = (w << 5) + bit;
             keys_available--;
-            if (keys_available == 0) {
-                break;
-            }
         }
     }
-    uint8_t modifier = 0;
-    for(int i=0; i<8; i++) {
-        modifier += !!state_matrix[MODIFIER_INDEX + i] << i;
-    }
-    tud_hid_keyboard_report(
-        REPORT_KEYBOARD,
-        modifier,
-        report
-    );
+    uint8_t report_id = boot ? 0 : HID_ID(REPORT_KEYBOARD);
+    return hid_send(HID_KEYBOARD, report_id, report, sizeof(report), false);
 }
 
 int16_t hid_axis(
@@ -300,118 +488,140 @@ int16_t hid_axis(
     uint8_t matrix_index_pos,
     uint8_t matrix_index_neg
 ) {
-    if (state_matrix[matrix_index_pos]) return 32767;
-    if (matrix_index_neg != 0 && state_matrix[matrix_index_neg]) return -32767;
+    if (hid_is_pressed(matrix_index_pos)) return 32767;
+    if (matrix_index_neg != 0 && hid_is_pressed(matrix_index_neg)) return -32767;
     return value;
 }
 
-void hid_gamepad_report() {
-    int32_t buttons = 0;
-    for(int i=0; i<16; i++) {
-        buttons += state_matrix[GAMEPAD_INDEX + i] << i;
-    }
+bool hid_gamepad_report() {
+    int32_t buttons = hid_matrix_bits(GAMEPAD_INDEX, 16);
     int16_t lx_report = hid_axis(gamepad_lx, GAMEPAD_AXIS_LX, GAMEPAD_AXIS_LX_NEG);
     int16_t ly_report = hid_axis(gamepad_ly, GAMEPAD_AXIS_LY, GAMEPAD_AXIS_LY_NEG);
     int16_t rx_report = hid_axis(gamepad_rx, GAMEPAD_AXIS_RX, GAMEPAD_AXIS_RX_NEG);
     int16_t ry_report = hid_axis(gamepad_ry, GAMEPAD_AXIS_RY, GAMEPAD_AXIS_RY_NEG);
     int16_t lz_report = hid_axis(gamepad_lz, GAMEPAD_AXIS_LZ, 0);
     int16_t rz_report = hid_axis(gamepad_rz, GAMEPAD_AXIS_RZ, 0);
-    hid_gamepad_report_t report = {
-        lx_report / 256,
-        ly_report / 256,
-        rx_report / 256,
-        ry_report / 256,
-        lz_report / 256,
-        rz_report / 256,
-        0,
-        buttons,
-    };
-    tud_hid_report(REPORT_GAMEPAD, &report, sizeof(report));
-}
-
-void hid_xinput_report() {
-    int8_t buttons_0 = 0;
-    int8_t buttons_1 = 0;
-    for(int i=0; i<8; i++) {
-        buttons_0 += state_matrix[GAMEPAD_INDEX + i] << i;
-    }
-    for(int i=0; i<8; i++) {
-        buttons_1 += state_matrix[GAMEPAD_INDEX + i + 8] << i;
-    }
+    #if CFG_HID_GAMEPAD_16BIT
+        hid_gamepad_16bit_report report = {
+            .x = lx_report,
+            .y = ly_report,
+            .z = rx_report,
+            .rz = ry_report,
+            .rx = min(lz_report, 255),
+            .ry = min(rz_report, 255),
+            .buttons = buttons,
+        };
+    #else
+        hid_gamepad_report_t report = {
+            lx_report / 256,
+            ly_report / 256,
+            rx_report / 256,
+            ry_report / 256,
+            lz_report / 256,
+            rz_report / 256,
+            0,
+            buttons,
+        };
+    #endif
+    return hid_send(HID_GAMEPAD, HID_ID(REPORT_GAMEPAD), &report, sizeof(report), false);
+}
+
+// Returns false if the endpoint is busy and the report must wait.
+bool hid_xinput_report() {
+    uint8_t buttons_0 = hid_matrix_bits(GAMEPAD_INDEX, 8);
+    uint8_t buttons_1 = hid_matrix_bits(GAMEPAD_INDEX + 8, 8);
     int16_t lx_report = hid_axis(gamepad_lx, GAMEPAD_AXIS_LX, GAMEPAD_AXIS_LX_NEG);
     int16_t ly_report = hid_axis(gamepad_ly, GAMEPAD_AXIS_LY, GAMEPAD_AXIS_LY_NEG);
     int16_t rx_report = hid_axis(gamepad_rx, GAMEPAD_AXIS_RX, GAMEPAD_AXIS_RX_NEG);
     int16_t ry_report = hid_axis(gamepad_ry, GAMEPAD_AXIS_RY, GAMEPAD_AXIS_RY_NEG);
     int16_t lz_report = hid_axis(gamepad_lz, GAMEPAD_AXIS_LZ, 0);
     int16_t rz_report = hid_axis(gamepad_rz, GAMEPAD_AXIS_RZ, 0);
-    xinput_report report = {
-        .report_id   = 0,
-        .report_size = XINPUT_REPORT_SIZE,
-        .buttons_0   = buttons_0,
-        .buttons_1   = buttons_1,
-        .lz          = lz_report,
-        .rz          = rz_report,
-        .lx          = lx_report,
-        .ly          = -ly_report,
-        .rx          = rx_report,
-        .ry          = -ry_report,
-        .reserved    = {0, 0, 0, 0, 0, 0}
-    };
-    xinput_send_report(&report);
+    // Built in place, the buffer is what the endpoint transfers.
+    xinput_report *report = xinput_report_buffer();
+    report->report_id = 0;
+    report->report_size = XINPUT_REPORT_SIZE;
+    report->buttons_0 = buttons_0;
+    report->buttons_1 = buttons_1;
+    report->lz = lz_report;
+    report->rz = rz_report;
+    report->lx = lx_report;
+    report->ly = -ly_report;
+    report->rx = rx_report;
+    report->ry = -ry_report;
+    memset(report->reserved, 0, sizeof(report->reserved));
+    if (hid_cache_match(HID_CACHE_XINPUT, report, sizeof(xinput_report))) {
+        hid_report_skipped(HID_GAMEPAD, sizeof(xinput_report));
+        return true;
+    }
+    if (!xinput_send_report()) return false;
+    hid_cache_store(HID_CACHE_XINPUT, report, sizeof(xinput_report));
+    hid_report_sent(HID_GAMEPAD);
+    return true;
+}
+
+bool hid_report_class(uint8_t class) {
+    if (class == HID_KEYBOARD) return hid_keyboard_report();
+    if (class == HID_MOUSE) return hid_mouse_report();
+    if (class == HID_GAMEPAD) return hid_gamepad_report();
+    return true;
+}
+
+// Send queued reports whose endpoint is free, also called when a report
+// transfer completes. Classes sharing an endpoint keep their queue order.
+// The XInput gamepad is not queued, it is retried while it stays dirty.
+void hid_report_drain() {
+    if (!hid_allow_communication) return;
+    uint8_t i = 0;
+    while (i < hid_queue_len) {
+        uint8_t class = hid_queue[i];
+        if (!tud_hid_n_ready(HID_INSTANCE(class))) {
+            i++;
+            continue;
+        }
+        // Nothing but the keyboard can be reported in boot protocol, unless
+        // the other classes have their own interfaces.
+        bool shared = !CFG_HID_SEPARATE_INTERFACES;
+        bool dropped = class != HID_KEYBOARD && shared && hid_is_boot_protocol();
+        // Refused by the endpoint, it keeps its place for the next drain.
+        if (!dropped && !hid_report_class(class)) break;
+        uint32_t irq = save_and_disable_interrupts();
+        hid_queue_len--;
+        memmove(&hid_queue[i], &hid_queue[i + 1], hid_queue_len - i);
+        state_dirty &= ~(1 << class);
+        restore_interrupts(irq);
+    }
+    if ((state_dirty & HID_DIRTY_GAMEPAD) && hid_is_xinput_class(HID_GAMEPAD)) {
+        if (hid_xinput_report()) state_dirty &= ~HID_DIRTY_GAMEPAD;
+    }
 }
 
 void hid_report() {
-    static bool is_tud_ready = false;
     static bool is_tud_ready_logged = false;
-    static uint8_t priority_mouse = 0;
-    static uint8_t priority_gamepad = 0;
-
-    if (!synced_mouse) priority_mouse += 1 * CFG_HID_REPORT_PRIORITY_RATIO;
-    if (!synced_gamepad) priority_gamepad += 1;
 
     if (!hid_allow_communication) return;
+    PROFILER_START(PROFILER_TUD_TASK);
     tud_task();
+    PROFILER_STOP(PROFILER_TUD_TASK);
     if (tud_ready()) {
-        is_tud_ready = true;
         if (!is_tud_ready_logged) {
             is_tud_ready_logged = true;
             // hid_matrix_reset();
             printf("USB: tud_ready TRUE\n");
+            // A new host has seen none of the cached reports.
+            hid_resync();
         }
 
-        // xinput_receive_report();
-
-        if (tud_hid_ready()) {
-            if (!synced_keyboard) {
-                hid_keyboard_report();
-                synced_keyboard = true;
-                return;
-            }
-            if (!synced_mouse && (priority_mouse > priority_gamepad)) {
-                hid_mouse_report();
-                synced_mouse = true;
-                priority_mouse = 0;
-                return;
-            }
-            if (!synced_gamepad && config_get_os_mode() == OS_MODE_GENERIC) {
-                hid_gamepad_report();
-                synced_gamepad = true;
-                priority_gamepad = 0;
-                return;
-            }
-        }
-
-        if (!synced_gamepad && config_get_os_mode() != OS_MODE_GENERIC) {
+        if ((state_dirty & HID_DIRTY_GAMEPAD) && hid_is_xinput_class(HID_GAMEPAD)) {
             if (tud_suspended()) {
                 tud_remote_wakeup();
             }
-            hid_xinput_report();
-            synced_gamepad = true;
-            priority_gamepad = 0;
-            return;
+        }
+        hid_report_drain();
+        // Whatever is still pending waits at least for the next frame.
+        for(uint8_t class=0; class<HID_CLASSES; class++) {
+            if (state_dirty & (1 << class)) hid_stats[class].deferred += 1;
         }
     } else {
-        is_tud_ready = false;
         if (is_tud_ready_logged) {
             is_tud_ready_logged = false;
             printf("USB: tud_ready FALSE\n");
@@ -419,6 +629,28 @@ void hid_report() {
     }
 }
 
+void hid_print_stats() {
+    static const char *names[HID_CLASSES] = {"keyboard", "mouse", "gamepad"};
+    printf("HID: pending=%u\n", hid_queue_len);
+    for(uint8_t class=0; class<HID_CLASSES; class++) {
+        printf(
+            "  %-8s sent=%lu coalesced=%lu deferred=%lu skipped=%lu (%lu bytes) "
+            "holder_overflows=%lu\n",
+            names[class],
+            hid_stats[class].sent,
+            hid_stats[class].coalesced,
+            hid_stats[class].deferred,
+            hid_stats[class].skipped,
+            hid_stats[class].skipped_bytes,
+            hid_stats[class].holder_overflows
+        );
+    }
+}
+
+void hid_reset_stats() {
+    memset(hid_stats, 0, sizeof(hid_stats));
+}
+
 // A not-so-secret easter egg.
 void hid_thanks_(alarm_id_t alarm) {
     cancel_alarm(alarm);
@@ -434,10 +666,10 @@ void hid_thanks_(alarm_id_t alarm) {
         return;
     }
     if (!p) {
-        hid_press(thanks_list[r][x]);
+        event_post(EVENT_PRESS, thanks_list[r][x], NULL);
         p = true;
     } else if (p) {
-        hid_release(thanks_list[r][x]);
+        event_post(EVENT_RELEASE, thanks_list[r][x], NULL);
         p = false;
         x += 1;
     }
@@ -450,5 +682,5 @@ void hid_thanks() {
 
 void hid_init() {
     printf("INIT: HID\n");
-    alarm_pool = alarm_pool_create(2, 255);
+    hid_resync();
 }
@@ -16,9 +16,11 @@
 #include "touch.h"
 #include "hid.h"
 #include "led.h"
+#include "sampler.h"
 #include "helper.h"
 
 double sensitivity_multiplier;
+uint8_t tick_samples = CFG_IMU_TICK_SAMPLES;
 double offset_0_x;
 double offset_0_y;
 double offset_0_z;
@@ -37,6 +39,11 @@ void imu_init() {
     printf("INIT: IMU\n");
     imu_init_single(PIN_SPI_CS0, IMU_CTRL2_G_500);
     imu_init_single(PIN_SPI_CS1, IMU_CTRL2_G_125);
+    imu_update_offsets();
+    imu_update_sensitivity();
+}
+
+void imu_update_offsets() {
     config_nvm_t config;
     config_read(&config);
     offset_0_x = config.imu_0_offset_x;
@@ -45,15 +52,23 @@ void imu_init() {
     offset_1_x = config.imu_1_offset_x;
     offset_1_y = config.imu_1_offset_y;
     offset_1_z = config.imu_1_offset_z;
-    imu_update_sensitivity();
 }
 
-vector_t imu_read_gyro_bits(uint8_t cs) {
+// Gyro axes as x, y, z, without offsets.
+void imu_read_gyro_raw(uint8_t cs, int16_t *axes) {
     uint8_t buf[6];
     bus_spi_read(cs, IMU_OUTX_L_G, buf, 6);
-    int16_t y =  (((int8_t)buf[1] << 8) + (int8_t)buf[0]);
-    int16_t z =  (((int8_t)buf[3] << 8) + (int8_t)buf[2]);
-    int16_t x = -(((int8_t)buf[5] << 8) + (int8_t)buf[4]);
+    axes[1] =  (((int8_t)buf[1] << 8) + (int8_t)buf[0]);
+    axes[2] =  (((int8_t)buf[3] << 8) + (int8_t)buf[2]);
+    axes[0] = -(((int8_t)buf[5] << 8) + (int8_t)buf[4]);
+}
+
+vector_t imu_read_gyro_bits(uint8_t cs) {
+    int16_t axes[3];
+    imu_read_gyro_raw(cs, axes);
+    int16_t x = axes[0];
+    int16_t y = axes[1];
+    int16_t z = axes[2];
     double offset_x = (cs==PIN_SPI_CS0) ? offset_0_x : offset_1_x;
     double offset_y = (cs==PIN_SPI_CS0) ? offset_0_y : offset_1_y;
     double offset_z = (cs==PIN_SPI_CS0) ? offset_0_z : offset_1_z;
@@ -81,8 +96,8 @@ vector_t imu_read_gyro_burst(uint8_t cs, uint8_t samples) {
 }
 
 vector_t imu_read_gyros() {
-    vector_t imu0 = imu_read_gyro_burst(PIN_SPI_CS0, CFG_IMU_TICK_SAMPLES/8*1);
-    vector_t imu1 = imu_read_gyro_burst(PIN_SPI_CS1, CFG_IMU_TICK_SAMPLES/8*7);
+    vector_t imu0 = imu_read_gyro_burst(PIN_SPI_CS0, tick_samples/8*1);
+    vector_t imu1 = imu_read_gyro_burst(PIN_SPI_CS1, tick_samples/8*7);
     double weight = max(abs(imu1.x), abs(imu1.y)) / 32768.0;
     double weight_0 = ramp_mid(weight, 0.2);
     double weight_1 = 1 - weight_0;
@@ -103,7 +118,7 @@ vector_t imu_read_gyro() {
     static double sub_y = 0;
     static double sub_z = 0;
     // Read gyro values.
-    vector_t gyro = imu_read_gyros();
+    vector_t gyro = sampler_is_running() ? sampler_get()->gyro : imu_read_gyros();
     double x = gyro.x * CFG_GYRO_SENSITIVITY_X * sensitivity_multiplier;
     double y = gyro.y * CFG_GYRO_SENSITIVITY_Y * sensitivity_multiplier;
     double z = gyro.z * CFG_GYRO_SENSITIVITY_Z * sensitivity_multiplier;
@@ -128,60 +143,6 @@ vector_t imu_read_gyro() {
     return (vector_t){x, y, z};
 }
 
-void imu_calibrate_single(uint8_t cs) {
-    printf("IMU: cs=%i calibrating...\n", cs);
-    uint32_t len = 200000;
-    if (cs == PIN_SPI_CS0) {
-        offset_0_x = 0;
-        offset_0_y = 0;
-        offset_0_z = 0;
-    }
-    if (cs == PIN_SPI_CS1) {
-        offset_1_x = 0;
-        offset_1_y = 0;
-        offset_1_z = 0;
-    }
-    double x = 0;
-    double y = 0;
-    double z = 0;
-    uint32_t i = 0;
-    while(i < len) {
-        if (!(i % 5000)) led_cycle_step();
-        vector_t sample = imu_read_gyro_bits(cs);
-        x += sample.x;
-        y += sample.y;
-        z += sample.z;
-        i++;
-    }
-    x /= len;
-    y /= len;
-    z /= len;
-    printf("IMU: cs=%i calibration x=%f y=%f z=%f\n", cs, x, y, z);
-    if (cs == PIN_SPI_CS0) {
-        offset_0_x = x;
-        offset_0_y = y;
-        offset_0_z = z;
-    }
-    if (cs == PIN_SPI_CS1) {
-        offset_1_x = x;
-        offset_1_y = y;
-        offset_1_z = z;
-    }
-}
-
-void imu_calibrate() {
-    imu_calibrate_single(PIN_SPI_CS0);
-    imu_calibrate_single(PIN_SPI_CS1);
-    config_set_imu_offset(
-        offset_0_x,
-        offset_0_y,
-        offset_0_z,
-        offset_1_x,
-        offset_1_y,
-        offset_1_z
-    );
-}
-
 void imu_update_sensitivity() {
     config_nvm_t config;
     config_read(&config);
@@ -190,5 +151,9 @@ void imu_update_sensitivity() {
         CFG_GYRO_SENSITIVITY_MULTIPLIER_MID,
         CFG_GYRO_SENSITIVITY_MULTIPLIER_HIGH
     };
-    sensitivity_multiplier = multipliers[config.sensitivity];
+    // Gyro values are reported as movement per tick, so faster ticks need
+    // proportionally smaller movements, and fewer samples fit in the tick.
+    float tick_ratio = (float)CFG_TICK_FREQUENCY_BASE / config_get_tick_frequency();
+    sensitivity_multiplier = multipliers[config.sensitivity] * tick_ratio;
+    tick_samples = CFG_IMU_TICK_SAMPLES * tick_ratio;
 }
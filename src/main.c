@@ -10,10 +10,16 @@
 #include "led.h"
 #include "bus.h"
 #include "profile.h"
+#include "calibration.h"
 #include "touch.h"
 #include "imu.h"
 #include "hid.h"
 #include "uart.h"
+#include "sampler.h"
+#include "tick.h"
+#include "event.h"
+#include "rumble.h"
+#include "profiler.h"
 
 #if __has_include("version.h")
     #include "version.h"
@@ -41,41 +47,46 @@ void main_init() {
     config_init();
     bus_init();
     hid_init();
+    event_init();
     led_init();
     thumbstick_init();
     touch_init();
     rotary_init();
+    rumble_init();
     profile_init();
     imu_init();
     tusb_init();
+    sampler_init();
+    profiler_init();
 }
 
 void main_loop() {
-    int16_t i = 0;
+    tick_init();
     while (true) {
-        // Start timer.
-        uint32_t tick_start = time_us_32();
+        // Wait for the next tick deadline.
+        tick_wait();
         // Report.
+        PROFILER_START(PROFILER_TICK);
+        event_run();
         profile_report_active();
+        PROFILER_START(PROFILER_HID);
         hid_report();
-        // Tick interval control.
-        uint32_t tick_completed = time_us_32() - tick_start;
-        uint16_t tick_interval = 1000000 / CFG_TICK_FREQUENCY;
-        int32_t tick_idle = tick_interval - (int32_t)tick_completed;
+        PROFILER_STOP(PROFILER_HID);
+        calibration_run();
+        PROFILER_STOP(PROFILER_TICK);
+        tick_completed();
+        uint32_t i = tick_get_count();
         // Listen to incoming UART messages.
-        if (!(i % CFG_TICK_FREQUENCY)) {
+        if (!(i % tick_get_frequency())) {
             uart_listen_char();
         }
-        // Print additional timing data.
-        if (CFG_LOG_LEVEL && !(i % 1000)) {
-            printf("Tick comp=%li idle=%i\n", tick_completed, tick_idle);
+        // Print additional timing data, every 1000 ticks at base frequency.
+        if (CFG_LOG_LEVEL && !(i % (1000 * tick_get_frequency() / CFG_TICK_FREQUENCY_BASE))) {
+            tick_print_stats();
+            if (sampler_is_running()) {
+                printf("Sampler overflows=%lu\n", sampler_get_overflows());
+            }
         }
-        if (tick_idle > 0) {
-            sleep_us((uint32_t)tick_idle);
-        } else {
-            printf("+");
-        }
-        i++;
     }
 }
 
@@ -8,7 +8,10 @@
 #include "bus.h"
 #include "pin.h"
 #include "hid.h"
+#include "event.h"
 #include "led.h"
+#include "sampler.h"
+#include "profiler.h"
 
 Profile profiles[16];
 uint8_t profile_active_index = -1;
@@ -23,7 +26,10 @@ Button home;
 
 void Profile__report(Profile *self) {
     if (!enabled_all) return;
-    bus_i2c_io_cache_update();
+    PROFILER_START(PROFILER_IO);
+    if (sampler_is_running()) sampler_pull();
+    else bus_i2c_io_cache_update();
+    PROFILER_STOP(PROFILER_IO);
     home.report(&home);
     self->select_1.report(&self->select_1);
     self->select_2.report(&self->select_2);
@@ -45,10 +51,14 @@ void Profile__report(Profile *self) {
     self->r2.report(&self->r2);
     self->l4.report(&self->l4);
     self->r4.report(&self->r4);
+    PROFILER_START(PROFILER_THUMBSTICK);
     self->thumbstick.report(&self->thumbstick);
+    PROFILER_STOP(PROFILER_THUMBSTICK);
     self->dhat.report(&self->dhat);
     self->rotary.report(&self->rotary);
+    PROFILER_START(PROFILER_GYRO);
     self->gyro.report(&self->gyro);
+    PROFILER_STOP(PROFILER_GYRO);
 }
 
 void Profile__reset(Profile *self) {
@@ -113,6 +123,7 @@ void profile_update_leds() {
 
 void profile_report_active() {
     if (pending_reset) {
+        event_cancel_all();
         hid_matrix_reset();
         profile_reset_all();
         pending_reset = false;
@@ -0,0 +1,109 @@
+// SPDX-License-Identifier: GPL-2.0-only
+// Copyright (C) 2022, Input Labs Oy.
+
+// Per-stage execution time profiler.
+// Stages are timed in CPU cycles with the SysTick counter, which counts down
+// from 2^24 and wraps every ~134ms at 125MHz, far above any stage duration.
+// Stages may nest, an outer stage includes the time of the inner ones.
+
+#include <stdio.h>
+#include <hardware/clocks.h>
+#include <hardware/structs/systick.h>
+#include "config.h"
+#include "profiler.h"
+#include "helper.h"
+
+#define SYSTICK_MASK 0x00FFFFFF
+
+static const char *stage_names[PROFILER_STAGES] = {
+    "tick",
+    "io",
+    "buttons",
+    "thumbstick",
+    "gyro",
+    "imu",
+    "touch",
+    "hid",
+    "tud_task",
+};
+
+uint32_t profiler_starts[PROFILER_STAGES] = {0,};
+ProfilerHistogram profiler_histograms[PROFILER_STAGES];
+
+uint8_t profiler_bucket(uint32_t cycles) {
+    if (cycles < 4) return cycles;
+    uint8_t msb = 31 - __builtin_clz(cycles);
+    return ((msb - 1) * 4) + ((cycles >> (msb - 2)) & 3);
+}
+
+// Lowest cycle count that falls into the bucket.
+uint32_t profiler_bucket_floor(uint8_t bucket) {
+    if (bucket < 4) return bucket;
+    uint8_t msb = (bucket / 4) + 1;
+    return (4 + (bucket % 4)) << (msb - 2);
+}
+
+void profiler_start(ProfilerStage stage) {
+    profiler_starts[stage] = systick_hw->cvr;
+}
+
+void profiler_stop(ProfilerStage stage) {
+    uint32_t cycles = (profiler_starts[stage] - systick_hw->cvr) & SYSTICK_MASK;
+    ProfilerHistogram *histogram = &profiler_histograms[stage];
+    histogram->count += 1;
+    histogram->sum += cycles;
+    histogram->min = min(histogram->min, cycles);
+    histogram->max = max(histogram->max, cycles);
+    histogram->buckets[profiler_bucket(cycles)] += 1;
+}
+
+uint32_t profiler_percentile(ProfilerHistogram *histogram, uint8_t percent) {
+    uint32_t threshold = ((uint64_t)histogram->count * percent + 99) / 100;
+    uint32_t accumulated = 0;
+    for(uint8_t i=0; i<PROFILER_BUCKETS; i++) {
+        accumulated += histogram->buckets[i];
+        if (accumulated >= threshold) return profiler_bucket_floor(i);
+    }
+    return histogram->max;
+}
+
+void profiler_print() {
+    if (!CFG_PROFILER) {
+        printf("Profiler: disabled, see CFG_PROFILER\n");
+        return;
+    }
+    float mhz = clock_get_hz(clk_sys) / 1000000.0;
+    printf("Profiler: time in us (%.0fMHz)\n", mhz);
+    printf("  %-10s %8s %8s %8s %8s %8s\n", "stage", "count", "min", "avg", "p99", "max");
+    for(uint8_t i=0; i<PROFILER_STAGES; i++) {
+        ProfilerHistogram *histogram = &profiler_histograms[i];
+        if (histogram->count == 0) continue;
+        printf(
+            "  %-10s %8lu %8.1f %8.1f %8.1f %8.1f\n",
+            stage_names[i],
+            histogram->count,
+            histogram->min / mhz,
+            histogram->sum / histogram->count / mhz,
+            profiler_percentile(histogram, 99) / mhz,
+            histogram->max / mhz
+        );
+    }
+}
+
+void profiler_reset() {
+    for(uint8_t i=0; i<PROFILER_STAGES; i++) {
+        profiler_histograms[i] = (ProfilerHistogram){0,};
+        profiler_histograms[i].min = SYSTICK_MASK;
+    }
+}
+
+void profiler_init() {
+    if (!CFG_PROFILER) return;
+    printf("INIT: Profiler\n");
+    // Free-running SysTick from the processor clock.
+    systick_hw->csr = 0;
+    systick_hw->rvr = SYSTICK_MASK;
+    systick_hw->cvr = 0;
+    systick_hw->csr = M0PLUS_SYST_CSR_CLKSOURCE_BITS | M0PLUS_SYST_CSR_ENABLE_BITS;
+    profiler_reset();
+}
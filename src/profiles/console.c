@@ -45,6 +45,8 @@ Profile profile_init_console() {
         Button_(PIN_VIRTUAL, NORMAL, ACTIONS(KEY_NONE)),             // Inner.
         Button_(PIN_VIRTUAL, NORMAL, ACTIONS(KEY_NONE))              // Outer.
     );
+    // Finer control around the center for aiming and slow movement.
+    profile.thumbstick.config_curve(&profile.thumbstick, 0, CURVE(CURVE_EXPONENTIAL, 1.5));
 
     profile.dhat = Dhat_(
         Button_(PIN_VIRTUAL, NORMAL, ACTIONS(KEY_1)),      // Left.
@@ -17,8 +17,9 @@ Profile profile_init_home() {
     );
     profile.select_2 = Button_(
         PIN_SELECT_2,
-        NORMAL,
-        ACTIONS(KEY_F11)
+        HOLD_EXCLUSIVE_LONG,
+        ACTIONS(KEY_F11),
+        ACTIONS(PROC_TUNE_VIBRATION)
     );
     profile.start_1 = Button_(
         PIN_START_1,
@@ -102,7 +103,7 @@ Profile profile_init_home() {
         Button_(PIN_VIRTUAL, NORMAL, ACTIONS(KEY_F8)),                                                   // ↖
         Button_(PIN_VIRTUAL, NORMAL, ACTIONS(KEY_F7)),                                                   // ↗
         Button_(PIN_VIRTUAL, NORMAL, ACTIONS(KEY_F5)),                                                   // ↙
-        Button_(PIN_VIRTUAL, NORMAL, ACTIONS(KEY_F6)),                                                   // ↘
+        Button_(PIN_VIRTUAL, HOLD_EXCLUSIVE_LONG, ACTIONS(KEY_F6), ACTIONS(PROC_TUNE_TICK_RATE)),        // ↘
         Button_(PIN_VIRTUAL, NORMAL, ACTIONS(KEY_BACKQUOTE))                                             // Push.
     );
 
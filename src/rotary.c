@@ -12,12 +12,25 @@
 #include "button.h"
 #include "rotary.h"
 #include "hid.h"
+#include "tick.h"
+#include "event.h"
+#include "helper.h"
 
+// Shared GPIO interrupt callback, any edge also wakes the tick scheduler.
+// The step is posted to the main loop, which owns the rotary state.
 void rotary_callback(uint gpio, uint32_t events) {
+    tick_wake();
+    if (gpio != PIN_ROTARY_A) return;
+    int8_t increment = gpio_get(PIN_ROTARY_A) ^ gpio_get(PIN_ROTARY_B) ? -1 : 1;
+    event_post(EVENT_ROTARY, (uint8_t)increment, NULL);
+}
+
+void rotary_increment(int8_t increment, uint32_t timestamp) {
     Profile* profile = profile_get_active(false);
     Rotary* rotary = &(profile->rotary);
-    rotary->timestamp = time_us_32();
-    rotary->increment = gpio_get(PIN_ROTARY_A) ^ gpio_get(PIN_ROTARY_B) ? -1 : 1;
+    if (!rotary->pending) rotary->timestamp_reported = rotary->timestamp;
+    rotary->timestamp = timestamp;
+    rotary->increment = limit_between(rotary->increment + increment, -127, 127);
     rotary->pending = true;
 }
 
@@ -37,19 +50,41 @@ void rotary_init() {
     );
 }
 
+// Wheel units per detent, growing linearly up to CFG_MOUSE_WHEEL_ACCEL_MAX
+// times as the interval between detents gets shorter.
+int16_t rotary_wheel_units(uint32_t interval) {
+    int16_t units = CFG_HID_WHEEL_MULTIPLIER;
+    if (interval >= CFG_MOUSE_WHEEL_ACCEL_INTERVAL) return units;
+    uint32_t speed = CFG_MOUSE_WHEEL_ACCEL_INTERVAL - interval;
+    return units + (
+        units * (CFG_MOUSE_WHEEL_ACCEL_MAX - 1) * speed
+        / CFG_MOUSE_WHEEL_ACCEL_INTERVAL
+    );
+}
+
 void Rotary__report(Rotary *self) {
     if (
         self->pending &&
         (time_us_32() > (self->timestamp + CFG_MOUSE_WHEEL_DEBOUNCE))
     ) {
-        uint8_t actions[8] = {0,};
-        for(uint8_t r=0; r<abs(self->increment); r++) {
-            for(uint8_t i=0; i<ACTIONS_LEN; i++) {
-                uint8_t action = (
-                    self->increment > 0
-                    ? self->actions_up[i]
-                    : self->actions_down[i]
-                );
+        uint8_t detents = abs(self->increment);
+        if (!detents) {
+            self->pending = false;
+            return;
+        }
+        uint32_t interval = (self->timestamp - self->timestamp_reported) / detents;
+        for(uint8_t i=0; i<ACTIONS_LEN; i++) {
+            uint8_t action = (
+                self->increment > 0
+                ? self->actions_up[i]
+                : self->actions_down[i]
+            );
+            if (action == MOUSE_SCROLL_UP || action == MOUSE_SCROLL_DOWN) {
+                int16_t units = detents * rotary_wheel_units(interval);
+                hid_mouse_wheel(action == MOUSE_SCROLL_UP ? units : -units);
+                continue;
+            }
+            for(uint8_t r=0; r<detents; r++) {
                 hid_press(action);
                 hid_release_later(action, 100);
             }
@@ -63,6 +98,7 @@ void Rotary__reset(Rotary *self) {
     self->pending = false;
     self->increment = 0;
     self->timestamp = 0;
+    self->timestamp_reported = 0;
 }
 
 Rotary Rotary_ (
@@ -75,6 +111,7 @@ Rotary Rotary_ (
     rotary.pending = false;
     rotary.increment = 0;
     rotary.timestamp = 0;
+    rotary.timestamp_reported = 0;
     rotary.actions_up[0] = 0;
     rotary.actions_up[1] = 0;
     rotary.actions_up[2] = 0;
@@ -0,0 +1,59 @@
+// SPDX-License-Identifier: GPL-2.0-only
+// Copyright (C) 2022, Input Labs Oy.
+
+// Rumble motor output.
+// Hosts set the strength of a large (left) and a small (right) motor, the
+// single motor is driven by PWM with the stronger of both, scaled by the
+// vibration preset. Only registers are written, so it is safe to call from
+// the USB transfer callbacks.
+
+#include <stdio.h>
+#include <pico/stdlib.h>
+#include <hardware/pwm.h>
+#include "config.h"
+#include "pin.h"
+#include "helper.h"
+#include "rumble.h"
+
+uint8_t rumble_left = 0;
+uint8_t rumble_right = 0;
+uint8_t rumble_strength = 0;  // Percent.
+
+void rumble_apply() {
+    #if PIN_RUMBLE != PIN_NONE
+        uint16_t level = max(rumble_left, rumble_right) * rumble_strength / 100;
+        pwm_set_gpio_level(PIN_RUMBLE, level);
+    #endif
+}
+
+void rumble_set(uint8_t left, uint8_t right) {
+    if (left == rumble_left && right == rumble_right) return;
+    rumble_left = left;
+    rumble_right = right;
+    rumble_apply();
+}
+
+void rumble_update_strength() {
+    config_nvm_t config;
+    config_read(&config);
+    uint8_t strengths[4] = {
+        CFG_VIBRATION_0,
+        CFG_VIBRATION_1,
+        CFG_VIBRATION_2,
+        CFG_VIBRATION_3
+    };
+    rumble_strength = strengths[limit_between(config.vibration, 0, 3)];
+    rumble_apply();
+}
+
+void rumble_init() {
+    printf("INIT: Rumble\n");
+    #if PIN_RUMBLE != PIN_NONE
+        gpio_set_function(PIN_RUMBLE, GPIO_FUNC_PWM);
+        uint8_t slice_num = pwm_gpio_to_slice_num(PIN_RUMBLE);
+        pwm_set_wrap(slice_num, 255);
+        pwm_set_gpio_level(PIN_RUMBLE, 0);
+        pwm_set_enabled(slice_num, true);
+    #endif
+    rumble_update_strength();
+}
@@ -0,0 +1,148 @@
+// SPDX-License-Identifier: GPL-2.0-only
+// Copyright (C) 2022, Input Labs Oy.
+
+// Sensor acquisition on core 1.
+// Core 1 continuously reads the IO expanders, the thumbstick ADC, the IMUs
+// and the touch sensor, and publishes timestamped snapshots into a
+// single-producer single-consumer ring. Core 0 drains the ring once per tick,
+// so it only does the mapping and the USB communication.
+//
+// The producer never waits for the consumer, when the ring is full it
+// overwrites the oldest slot, so core 0 always gets the freshest samples.
+// Each slot carries the sequence number of the sample it holds, zero while
+// being written, and the consumer only keeps a copy whose sequence number
+// did not change while it was copied.
+
+#include <stdio.h>
+#include <pico/stdlib.h>
+#include <pico/multicore.h>
+#include <hardware/sync.h>
+#include <hardware/adc.h>
+#include "config.h"
+#include "sampler.h"
+#include "bus.h"
+#include "imu.h"
+#include "touch.h"
+#include "thumbstick.h"
+
+sample_t sample_ring[SAMPLER_RING_LEN];
+volatile uint32_t sample_seq[SAMPLER_RING_LEN];  // Index of the sample plus one.
+volatile uint32_t sample_head = 0;  // Only written by core 1.
+uint32_t sample_tail = 0;  // Only used by core 0.
+uint32_t sample_overflows = 0;  // Samples overwritten before being read.
+volatile bool sampler_pause_request = false;
+volatile bool sampler_paused = false;
+bool sampler_running = false;
+sample_t sample_current;
+
+void sampler_acquire(sample_t *sample) {
+    sample->timestamp = time_us_32();
+    sample->io_0 = bus_i2c_read_two(I2C_IO_0, I2C_IO_REG_INPUT);
+    sample->io_1 = bus_i2c_read_two(I2C_IO_1, I2C_IO_REG_INPUT);
+    // With free-running sampling the thumbstick does not go through here.
+    #if !CFG_THUMBSTICK_ADC_DMA
+        sample->adc[0] = thumbstick_adc_raw(0);
+        sample->adc[1] = thumbstick_adc_raw(1);
+    #endif
+    sample->gyro = imu_read_gyros();
+    sample->touch_elapsed = touch_get_elapsed();
+}
+
+void sampler_core1() {
+    while (true) {
+        if (sampler_pause_request) {
+            sampler_paused = true;
+            while (sampler_pause_request) tight_loop_contents();
+            sampler_paused = false;
+        }
+        uint32_t head = sample_head;
+        uint32_t slot = head & (SAMPLER_RING_LEN - 1);
+        sample_seq[slot] = 0;
+        __dmb();  // Invalidate the slot before overwriting it.
+        sampler_acquire(&sample_ring[slot]);
+        __dmb();  // Publish the sample before its sequence and the index.
+        sample_seq[slot] = head + 1;
+        sample_head = head + 1;
+    }
+}
+
+void sampler_pull() {
+    uint32_t head = sample_head;
+    __dmb();  // Read the index before the samples.
+    uint32_t tail = sample_tail;
+    if (head == tail) return;  // Keep the previous snapshot.
+    // The slot after the head may be being overwritten, older samples are
+    // already lost.
+    if (head - tail > SAMPLER_RING_LEN - 1) {
+        sample_overflows += head - tail - (SAMPLER_RING_LEN - 1);
+        tail = head - (SAMPLER_RING_LEN - 1);
+    }
+    double x = 0;
+    double y = 0;
+    double z = 0;
+    uint32_t count = 0;
+    sample_t sample;
+    for(; tail != head; tail++) {
+        uint32_t slot = tail & (SAMPLER_RING_LEN - 1);
+        if (sample_seq[slot] != tail + 1) {
+            sample_overflows++;
+            continue;
+        }
+        __dmb();  // Check the sequence before copying.
+        sample = sample_ring[slot];
+        __dmb();  // Finish copying before checking it again.
+        if (sample_seq[slot] != tail + 1) {
+            sample_overflows++;
+            continue;
+        }
+        x += sample.gyro.x;
+        y += sample.gyro.y;
+        z += sample.gyro.z;
+        sample_current = sample;
+        count++;
+    }
+    sample_tail = tail;
+    if (!count) return;
+    // Gyro is averaged over all samples since the previous tick, everything
+    // else uses the most recent snapshot.
+    sample_current.gyro = (vector_t){x / count, y / count, z / count};
+    bus_i2c_io_cache_set(
+        sample_current.io_0,
+        sample_current.io_1,
+        sample_current.timestamp
+    );
+}
+
+sample_t* sampler_get() {
+    return &sample_current;
+}
+
+bool sampler_is_running() {
+    return sampler_running;
+}
+
+uint32_t sampler_get_overflows() {
+    return sample_overflows;
+}
+
+void sampler_pause(bool pause) {
+    if (!CFG_DUAL_CORE) return;
+    if (pause) {
+        // Core 0 takes back the buses, wait until core 1 is idle.
+        sampler_running = false;
+        sampler_pause_request = true;
+        while (!sampler_paused) tight_loop_contents();
+    } else {
+        sampler_pause_request = false;
+        while (sampler_paused) tight_loop_contents();
+        sampler_running = true;
+    }
+}
+
+void sampler_init() {
+    if (!CFG_DUAL_CORE) return;
+    printf("INIT: Sampler (core 1)\n");
+    sampler_acquire(&sample_current);
+    multicore_launch_core1(sampler_core1);
+    sampler_running = true;
+}
@@ -7,6 +7,8 @@
 #include "pin.h"
 #include "profile.h"
 #include "uart.h"
+#include "sampler.h"
+#include "event.h"
 
 void self_test_button_press(const char *buttonName, Button* button) {
     printf("Press button '%s': WAITING", buttonName);
@@ -84,7 +86,10 @@ void self_test_dhat(Dhat* dhat) {
 void self_test_rotary_direction(Rotary* rotary, const char *name, int8_t direction) {
     rotary->increment = 0;
     printf("Scroll %s: WAITING", name);
-    while (rotary->increment != direction) {
+    // Steps are posted from the interrupt and applied by the event queue,
+    // they may also come accelerated, so only the sign is checked.
+    while (direction > 0 ? rotary->increment <= 0 : rotary->increment >= 0) {
+        event_run();
         uart_listen_char_limited();
         sleep_ms(1);
     }
@@ -99,6 +104,7 @@ void self_test_rotary(Rotary* rotary) {
 
 void self_test() {
     profile_enable_all(false);
+    sampler_pause(true);
     printf("Tests start\n");
     printf("===========\n");
     Profile* profile = profile_get_active(true);
@@ -109,5 +115,6 @@ void self_test() {
     printf("Tests done\n");
     printf("==========\n");
     profile->reset(profile);
+    sampler_pause(false);
     profile_enable_all(true);
 }
@@ -2,10 +2,12 @@
 // Copyright (C) 2022, Input Labs Oy.
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <math.h>
 #include <pico/stdlib.h>
 #include <stdarg.h>
 #include <hardware/adc.h>
+#include <hardware/dma.h>
 #include "config.h"
 #include "pin.h"
 #include "button.h"
@@ -14,10 +16,13 @@
 #include "hid.h"
 #include "led.h"
 #include "profile.h"
+#include "sampler.h"
+#include "tick.h"
 
-float offset_x = 0;
-float offset_y = 0;
-float config_deadzone = 0;
+// Positions are Q15 fixed-point, 1.0 being 32768.
+int32_t offset_x = 0;
+int32_t offset_y = 0;
+int32_t config_deadzone = 0;
 
 // Daisywheel.
 bool daisywheel_used = false;
@@ -26,11 +31,236 @@ Button daisy_b;
 Button daisy_x;
 Button daisy_y;
 
-float thumbstick_adc(uint8_t adc_index, float offset) {
+#if CFG_THUMBSTICK_ADC_DMA
+
+// Free-running sampling.
+// The ADC converts both axes in round-robin and a DMA channel writes them
+// into a ring, even slots being ADC 0. Every tick averages the samples
+// written since the previous one, so reading never waits on a conversion.
+uint16_t adc_ring[THUMBSTICK_ADC_RING_LEN]
+    __attribute__((aligned(THUMBSTICK_ADC_RING_LEN * sizeof(uint16_t))));
+uint adc_dma = 0;
+uint32_t adc_dma_remaining = 0;
+uint32_t adc_dma_index = 0;
+uint16_t adc_filtered[2] = {2048, 2048};
+
+// Start the ADC and the ring in step, from ADC 0 on the first slot. The
+// ADC is stopped and its FIFO drained first, otherwise samples it converted
+// while the channel was idle would shift the pairing of slots and axes.
+void thumbstick_adc_dma_start() {
+    adc_run(false);
+    adc_fifo_drain();
+    adc_select_input(0);
+    adc_dma_remaining = UINT32_MAX;
+    adc_dma_index = 0;
+    dma_channel_set_write_addr(adc_dma, adc_ring, false);
+    dma_channel_set_trans_count(adc_dma, adc_dma_remaining, true);
+    adc_run(true);
+}
+
+void thumbstick_adc_dma_init() {
+    adc_set_round_robin(0b11);
+    adc_fifo_setup(true, true, 1, false, false);
+    adc_set_clkdiv(48000000.0 / CFG_THUMBSTICK_ADC_RATE - 1);
+    adc_dma = dma_claim_unused_channel(true);
+    dma_channel_config config = dma_channel_get_default_config(adc_dma);
+    channel_config_set_transfer_data_size(&config, DMA_SIZE_16);
+    channel_config_set_read_increment(&config, false);
+    channel_config_set_write_increment(&config, true);
+    channel_config_set_ring(&config, true, THUMBSTICK_ADC_RING_BITS);
+    channel_config_set_dreq(&config, DREQ_ADC);
+    dma_channel_configure(adc_dma, &config, adc_ring, &adc_hw->fifo, 0, false);
+    thumbstick_adc_dma_start();
+}
+
+// Average the samples of each axis written since the previous call, at
+// most half the ring so the DMA is never reading into what is written.
+void thumbstick_adc_decimate() {
+    uint32_t remaining = dma_channel_hw_addr(adc_dma)->transfer_count;
+    uint32_t count = adc_dma_remaining - remaining;
+    adc_dma_remaining = remaining;
+    adc_dma_index += count;
+    uint32_t window = min(count, THUMBSTICK_ADC_RING_LEN / 2);
+    uint32_t sum[2] = {0, 0};
+    uint32_t len[2] = {0, 0};
+    for(uint32_t i=adc_dma_index-window; i!=adc_dma_index; i++) {
+        sum[i & 1] += adc_ring[i & (THUMBSTICK_ADC_RING_LEN - 1)];
+        len[i & 1] += 1;
+    }
+    // Without new samples the previous values are kept.
+    if (len[0]) adc_filtered[0] = sum[0] / len[0];
+    if (len[1]) adc_filtered[1] = sum[1] / len[1];
+    // The transfer count runs out after days, then it is restarted.
+    if (!dma_channel_is_busy(adc_dma)) thumbstick_adc_dma_start();
+}
+
+uint16_t thumbstick_adc_raw(uint8_t adc_index) {
+    return adc_filtered[adc_index];
+}
+
+#else
+
+uint16_t thumbstick_adc_raw(uint8_t adc_index) {
     adc_select_input(adc_index);
-    float value = (float)adc_read() - 2048;
-    value = value / 2048 * CFG_THUMBSTICK_SATURATION;
-    return limit_between(value - offset, -1, 1);
+    return adc_read();
+}
+
+#endif
+
+// Refresh the averaged readings, at most once per tick whoever asks.
+void thumbstick_adc_update() {
+    #if CFG_THUMBSTICK_ADC_DMA
+        static uint32_t updated = UINT32_MAX;
+        if (tick_get_count() == updated) return;
+        updated = tick_get_count();
+        thumbstick_adc_decimate();
+    #endif
+}
+
+// Centered and saturated axis value from a raw ADC reading.
+int32_t thumbstick_axis(uint16_t raw, int32_t offset) {
+    int32_t value = ((int32_t)raw - 2048) * THUMBSTICK_SATURATION_Q16 / 4096;
+    return limit_between(value - offset, -THUMBSTICK_ONE, THUMBSTICK_ONE);
+}
+
+int32_t thumbstick_adc(uint8_t adc_index, int32_t offset) {
+    uint16_t raw = (
+        sampler_is_running() && !CFG_THUMBSTICK_ADC_DMA ?
+        sampler_get()->adc[adc_index] :
+        thumbstick_adc_raw(adc_index)
+    );
+    return thumbstick_axis(raw, offset);
+}
+
+// Integer square root, rounded down.
+uint32_t thumbstick_isqrt(uint32_t value) {
+    uint32_t root = 0;
+    uint32_t bit = 1UL << 30;
+    while (bit > value) bit >>= 2;
+    while (bit) {
+        if (value >= root + bit) {
+            value -= root + bit;
+            root = (root >> 1) + bit;
+        } else {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return root;
+}
+
+// Scale a Q15 value by a Q15 radius over a Q16 radius, rounded.
+int32_t thumbstick_scale(int32_t value, uint32_t radius, uint32_t raw) {
+    uint32_t scaled = ((uint32_t)abs(value) * radius * 2 + raw / 2) / raw;
+    return value < 0 ? -(int32_t)scaled : (int32_t)scaled;
+}
+
+// Radius clamped to 1 and with the deadzone ramped out, the direction is
+// kept by scaling x and y by the ratio of the new radius to the raw one.
+// Below 1 the raw radius is computed in Q16 for an extra bit of precision.
+ThumbstickPosition thumbstick_position(int32_t x, int32_t y, int32_t deadzone) {
+    ThumbstickPosition pos = {0, 0, 0};
+    uint32_t squared = (uint32_t)(x*x) + (uint32_t)(y*y);
+    uint32_t raw = (
+        squared < (1UL << 30) ?
+        thumbstick_isqrt(squared << 2) :
+        thumbstick_isqrt(squared) << 1
+    );
+    uint32_t radius = min(raw, THUMBSTICK_ONE * 2);
+    uint32_t deadzone_q16 = deadzone * 2;
+    if (radius <= deadzone_q16) return pos;
+    pos.radius = (
+        ((radius - deadzone_q16) * THUMBSTICK_ONE + THUMBSTICK_ONE - deadzone)
+        / ((THUMBSTICK_ONE - deadzone) * 2)
+    );
+    pos.x = thumbstick_scale(x, pos.radius, raw);
+    pos.y = thumbstick_scale(y, pos.radius, raw);
+    return pos;
+}
+
+// Sector classification, on the components only.
+// A position is in the horizontal sectors when its angle from the vertical
+// axis is at least the cut, |x|/|y| >= tan(cut), and in the vertical ones
+// when its angle from the horizontal axis is at least the cut,
+// |y|/|x| >= tan(cut). The tangent is kept as the Q15 sine and cosine of
+// the cut, so each test is two products that cannot overflow.
+uint8_t thumbstick_dir4_mask(int32_t x, int32_t y, int32_t cut_sin, int32_t cut_cos) {
+    int32_t h = abs(x);
+    int32_t v = abs(y);
+    uint8_t mask = 0;
+    if (h * cut_cos >= v * cut_sin) mask |= x < 0 ? DIR4_MASK_LEFT : DIR4_MASK_RIGHT;
+    if (v * cut_cos >= h * cut_sin) mask |= y < 0 ? DIR4_MASK_UP : DIR4_MASK_DOWN;
+    return mask;
+}
+
+// Exclusive 4 directions, diagonals go to the horizontal ones.
+Dir4 thumbstick_dir4(int32_t x, int32_t y) {
+    if (abs(x) >= abs(y)) return x < 0 ? DIR4_LEFT : DIR4_RIGHT;
+    return y < 0 ? DIR4_UP : DIR4_DOWN;
+}
+
+// 8 directions of 45 degrees each, split at tan(22.5) and tan(67.5).
+Dir8 thumbstick_dir8(int32_t x, int32_t y) {
+    int32_t h = abs(x);
+    int32_t v = abs(y);
+    if (h * THUMBSTICK_ONE <= v * THUMBSTICK_TAN_22_5) return y < 0 ? DIR8_UP : DIR8_DOWN;
+    if (v * THUMBSTICK_ONE <= h * THUMBSTICK_TAN_22_5) return x < 0 ? DIR8_LEFT : DIR8_RIGHT;
+    if (y < 0) return x < 0 ? DIR8_UP_LEFT : DIR8_UP_RIGHT;
+    return x < 0 ? DIR8_DOWN_LEFT : DIR8_DOWN_RIGHT;
+}
+
+// Response curve as a function, on radii from 0 to 1.
+float thumbstick_curve_eval(ThumbstickCurve curve, const double *params, uint8_t len, float t) {
+    if (!len) return t;
+    if (curve == CURVE_EXPONENTIAL) return powf(t, params[0]);
+    if (curve == CURVE_S) {
+        float a = powf(t, params[0]);
+        float b = powf(1 - t, params[0]);
+        return a / (a + b);
+    }
+    if (curve == CURVE_POINTS) {
+        // Implicit end points at (0, 0) and (1, 1).
+        float x0 = 0;
+        float y0 = 0;
+        for(uint8_t i=0; i<=len; i+=2) {
+            float x1 = i < len ? params[i] : 1;
+            float y1 = i < len ? params[i+1] : 1;
+            if (t <= x1) return x1 > x0 ? y0 + (y1 - y0) * (t - x0) / (x1 - x0) : y1;
+            x0 = x1;
+            y0 = y1;
+        }
+        return 1;
+    }
+    return t;
+}
+
+// Sample the curve into a lookup table, with the anti-deadzone as the
+// output where the input leaves zero.
+void thumbstick_curve_build(
+    uint16_t *lut,
+    ThumbstickCurve curve,
+    float anti_deadzone,
+    const double *params,
+    uint8_t len
+) {
+    lut[0] = 0;
+    for(uint16_t i=1; i<THUMBSTICK_CURVE_LEN; i++) {
+        float t = (float)i / (THUMBSTICK_CURVE_LEN - 1);
+        float value = thumbstick_curve_eval(curve, params, len, t);
+        value = anti_deadzone + (1 - anti_deadzone) * limit_between(value, 0, 1);
+        lut[i] = THUMBSTICK_Q15(value);
+    }
+}
+
+// Curved radius, interpolated between the two nearest entries.
+int32_t thumbstick_curve(uint16_t *lut, int32_t radius) {
+    const uint8_t shift = 15 - THUMBSTICK_CURVE_BITS;
+    if (radius >= THUMBSTICK_ONE) return lut[THUMBSTICK_CURVE_LEN - 1];
+    uint32_t index = radius >> shift;
+    int32_t fraction = radius & ((1 << shift) - 1);
+    int32_t low = lut[index];
+    int32_t high = lut[index + 1];
+    return low + (((high - low) * fraction + (1 << (shift - 1))) >> shift);
 }
 
 void thumbstick_update_deadzone() {
@@ -41,31 +271,14 @@ void thumbstick_update_deadzone() {
         CFG_THUMBSTICK_DEADZONE_MID,
         CFG_THUMBSTICK_DEADZONE_HIGH
     };
-    config_deadzone = deadzones[config.deadzone];
+    config_deadzone = THUMBSTICK_Q15(deadzones[config.deadzone]);
 }
 
 void thumbstick_update_offsets() {
     config_nvm_t config;
     config_read(&config);
-    offset_x = config.ts_offset_x;
-    offset_y = config.ts_offset_y;
-}
-
-void thumbstick_calibrate() {
-    printf("Thumbstick: calibrating...\n");
-    float x = 0;
-    float y = 0;
-    uint32_t len = 100000;
-    for(uint32_t i=0; i<len; i++) {
-        if (!(i % 5000)) led_cycle_step();
-        x += thumbstick_adc(1, 0.0);
-        y += thumbstick_adc(0, 0.0);
-    }
-    x /= len;
-    y /= len;
-    printf("Thumbstick: calibration x=%f y=%f\n", x, y);
-    config_set_thumbstick_offset(x, y);
-    thumbstick_update_offsets();
+    offset_x = THUMBSTICK_Q15(config.ts_offset_x);
+    offset_y = THUMBSTICK_Q15(config.ts_offset_y);
 }
 
 void thumbstick_init() {
@@ -73,6 +286,9 @@ void thumbstick_init() {
     adc_init();
     adc_gpio_init(PIN_TX);
     adc_gpio_init(PIN_TY);
+    #if CFG_THUMBSTICK_ADC_DMA
+        thumbstick_adc_dma_init();
+    #endif
     thumbstick_update_offsets();
     thumbstick_update_deadzone();
     // Alternative usage of ABXY while doing daisywheel.
@@ -82,36 +298,50 @@ void thumbstick_init() {
     daisy_y = Button_(PIN_Y,  NORMAL, ACTIONS(KEY_NONE));
 }
 
-void thumbstick_report_axis(uint8_t axis, float value) {
-    if      (axis == GAMEPAD_AXIS_LX)     hid_gamepad_lx( value * ANALOG_FACTOR);
-    else if (axis == GAMEPAD_AXIS_LY)     hid_gamepad_ly(-value * ANALOG_FACTOR);
-    else if (axis == GAMEPAD_AXIS_RX)     hid_gamepad_rx( value * ANALOG_FACTOR);
-    else if (axis == GAMEPAD_AXIS_RY)     hid_gamepad_ry(-value * ANALOG_FACTOR);
-    else if (axis == GAMEPAD_AXIS_LX_NEG) hid_gamepad_lx(-value * ANALOG_FACTOR);
-    else if (axis == GAMEPAD_AXIS_LY_NEG) hid_gamepad_ly( value * ANALOG_FACTOR);
-    else if (axis == GAMEPAD_AXIS_RX_NEG) hid_gamepad_rx(-value * ANALOG_FACTOR);
-    else if (axis == GAMEPAD_AXIS_RY_NEG) hid_gamepad_ry( value * ANALOG_FACTOR);
-    else if (axis == GAMEPAD_AXIS_LZ) hid_gamepad_lz(max(0, value) * TRIGGER_FACTOR);
-    else if (axis == GAMEPAD_AXIS_RZ) hid_gamepad_rz(max(0, value) * TRIGGER_FACTOR);
+void thumbstick_report_axis(uint8_t axis, int32_t value) {
+    int16_t analog = value * ANALOG_FACTOR / THUMBSTICK_ONE;
+    int16_t trigger = max(0, value) * TRIGGER_FACTOR / THUMBSTICK_ONE;
+    if      (axis == GAMEPAD_AXIS_LX)     hid_gamepad_lx( analog);
+    else if (axis == GAMEPAD_AXIS_LY)     hid_gamepad_ly(-analog);
+    else if (axis == GAMEPAD_AXIS_RX)     hid_gamepad_rx( analog);
+    else if (axis == GAMEPAD_AXIS_RY)     hid_gamepad_ry(-analog);
+    else if (axis == GAMEPAD_AXIS_LX_NEG) hid_gamepad_lx(-analog);
+    else if (axis == GAMEPAD_AXIS_LY_NEG) hid_gamepad_ly( analog);
+    else if (axis == GAMEPAD_AXIS_RX_NEG) hid_gamepad_rx(-analog);
+    else if (axis == GAMEPAD_AXIS_RY_NEG) hid_gamepad_ry( analog);
+    else if (axis == GAMEPAD_AXIS_LZ) hid_gamepad_lz(trigger);
+    else if (axis == GAMEPAD_AXIS_RZ) hid_gamepad_rz(trigger);
 }
 
 void Thumbstick__report_4dir(
     Thumbstick *self,
     ThumbstickPosition pos,
-    float deadzone
+    int32_t deadzone
 ) {
     // Evaluate virtual buttons.
     if (pos.radius > deadzone) {
-        if (pos.radius < CFG_THUMBSTICK_INNER_RADIUS) self->inner.virtual_press = true;
+        if (pos.radius < THUMBSTICK_Q15(CFG_THUMBSTICK_INNER_RADIUS)) {
+            self->inner.virtual_press = true;
+        }
         else self->outer.virtual_press = true;
-        float cutA = 45 * (-self->overlap + 1);
-        float cutB = 180 - cutA;
-        if (is_between(pos.angle, -cutB, -cutA)) self->left.virtual_press = true;
-        if (is_between(pos.angle, cutA, cutB)) self->right.virtual_press = true;
-        if (fabs(pos.angle) <= 90 - cutA) self->up.virtual_press = true;
-        if (fabs(pos.angle) >= 90 + cutA) self->down.virtual_press = true;
+        uint8_t mask = thumbstick_dir4_mask(
+            pos.x,
+            pos.y,
+            self->overlap_sin,
+            self->overlap_cos
+        );
+        if (mask & DIR4_MASK_LEFT) self->left.virtual_press = true;
+        if (mask & DIR4_MASK_RIGHT) self->right.virtual_press = true;
+        if (mask & DIR4_MASK_UP) self->up.virtual_press = true;
+        if (mask & DIR4_MASK_DOWN) self->down.virtual_press = true;
     }
     // Report directional virtual buttons or axis.
+    // Axes follow the response curve, along the radius.
+    if (pos.radius) {
+        int32_t radius = thumbstick_curve(self->curve, pos.radius);
+        pos.x = thumbstick_scale(pos.x, radius, pos.radius * 2);
+        pos.y = thumbstick_scale(pos.y, radius, pos.radius * 2);
+    }
     if (!hid_is_axis(self->left.actions[0])) self->left.report(&self->left);
     else if (pos.x < 0) thumbstick_report_axis(self->left.actions[0], -pos.x);
     if (!hid_is_axis(self->right.actions[0])) self->right.report(&self->right);
@@ -230,6 +460,17 @@ void Thumbstick__config_daisywheel(Thumbstick *self, ...) {
     va_end(va);
 }
 
+void Thumbstick__config_curve(
+    Thumbstick *self,
+    float anti_deadzone,
+    ThumbstickCurve curve,
+    const double *params,
+    uint8_t len
+) {
+    if (curve == CURVE_POINTS) len &= ~1;  // Only complete pairs.
+    thumbstick_curve_build(self->curve, curve, anti_deadzone, params, len);
+}
+
 void Thumbstick__report_daisywheel(Thumbstick *self, Dir8 dir) {
     dir -= 1;  // Shift zero since not using center direction here.
     if (daisy_a.is_pressed(&daisy_a)) {
@@ -257,27 +498,10 @@ void Thumbstick__report_daisywheel(Thumbstick *self, Dir8 dir) {
 void Thumbstick__report_alphanumeric(Thumbstick *self, ThumbstickPosition pos) {
     static Dir4 input[8] = {0,};
     static uint8_t input_index = 0;
-    static float CUT4 = 45;
-    static float CUT4X = 135;  // 180-45
-    static float CUT8 = 22.5;
-    Dir4 dir4 = 0;
-    Dir8 dir8 = 0;
-    if (pos.radius > 0.7) {
+    if (pos.radius > THUMBSTICK_Q15(0.7)) {
         profile_enable_abxy(false);
-        // Detect direction 4.
-        if      (is_between(pos.angle, -CUT4X, -CUT4)) dir4 = DIR4_LEFT;
-        else if (is_between(pos.angle,  CUT4,  CUT4X)) dir4 = DIR4_RIGHT;
-        else if (fabs(pos.angle) <= 90 - CUT4)         dir4 = DIR4_UP;
-        else if (fabs(pos.angle) >= 90 + CUT4)         dir4 = DIR4_DOWN;
-        // Detect direction 8.
-        if      (is_between(pos.angle, -CUT8*1,  CUT8*1)) dir8 = DIR8_UP;
-        else if (is_between(pos.angle,  CUT8*1,  CUT8*3)) dir8 = DIR8_UP_RIGHT;
-        else if (is_between(pos.angle,  CUT8*3,  CUT8*5)) dir8 = DIR8_RIGHT;
-        else if (is_between(pos.angle,  CUT8*5,  CUT8*7)) dir8 = DIR8_DOWN_RIGHT;
-        else if (is_between(pos.angle, -CUT8*7, -CUT8*5)) dir8 = DIR8_DOWN_LEFT;
-        else if (is_between(pos.angle, -CUT8*5, -CUT8*3)) dir8 = DIR8_LEFT;
-        else if (is_between(pos.angle, -CUT8*3, -CUT8*1)) dir8 = DIR8_UP_LEFT;
-        else if (fabs(pos.angle) >= CUT8*7)               dir8 = DIR8_DOWN;
+        Dir4 dir4 = thumbstick_dir4(pos.x, pos.y);
+        Dir8 dir8 = thumbstick_dir8(pos.x, pos.y);
         // Record direction 4.
         if (input_index == 0 || dir4 != input[input_index-1]) {
             input[input_index] = dir4;
@@ -301,17 +525,11 @@ void Thumbstick__report_alphanumeric(Thumbstick *self, ThumbstickPosition pos) {
 
 void Thumbstick__report(Thumbstick *self) {
     // Get values from ADC.
-    float x = thumbstick_adc(1, offset_x);
-    float y = thumbstick_adc(0, offset_y);
-    // Calculate trigonometry.
-    float angle = atan2(x, -y) * (180 / M_PI);
-    float radius = sqrt(powf(x, 2) + powf(y, 2));
-    float deadzone = self->deadzone == DEADZONE_FROM_CONFIG ? config_deadzone : self->deadzone;
-    radius = limit_between(radius, 0, 1);
-    radius = ramp_low(radius, deadzone);
-    x = sin(radians(angle)) * radius;
-    y = -cos(radians(angle)) * radius;
-    ThumbstickPosition pos = {x, y, angle, radius};
+    thumbstick_adc_update();
+    int32_t x = thumbstick_adc(1, offset_x);
+    int32_t y = thumbstick_adc(0, offset_y);
+    int32_t deadzone = self->deadzone == DEADZONE_FROM_CONFIG ? config_deadzone : self->deadzone;
+    ThumbstickPosition pos = thumbstick_position(x, y, deadzone);
     // Report.
     if (self->mode == THUMBSTICK_MODE_4DIR) self->report_4dir(self, pos, deadzone);
     else if (self->mode == THUMBSTICK_MODE_ALPHANUMERIC) self->report_alphanumeric(self, pos);
@@ -349,8 +567,15 @@ Thumbstick Thumbstick_ (
     thumbstick.report_glyphstick = Thumbstick__report_glyphstick;
     thumbstick.config_daisywheel = Thumbstick__config_daisywheel;
     thumbstick.report_daisywheel = Thumbstick__report_daisywheel;
-    thumbstick.deadzone = deadzone;
-    thumbstick.overlap = overlap;
+    thumbstick.config_curve = Thumbstick__config_curve;
+    thumbstick.deadzone = (
+        deadzone == DEADZONE_FROM_CONFIG ?
+        DEADZONE_FROM_CONFIG :
+        THUMBSTICK_Q15(deadzone)
+    );
+    float cut = radians(45 * (-overlap + 1));
+    thumbstick.overlap_sin = THUMBSTICK_Q15(sin(cut));
+    thumbstick.overlap_cos = THUMBSTICK_Q15(cos(cut));
     thumbstick.left = left;
     thumbstick.right = right;
     thumbstick.up = up;
@@ -358,5 +583,6 @@ Thumbstick Thumbstick_ (
     thumbstick.inner = inner;
     thumbstick.outer = outer;
     thumbstick.push = push;
+    thumbstick.config_curve(&thumbstick, 0, CURVE(CURVE_LINEAR));
     return thumbstick;
 }
@@ -0,0 +1,281 @@
+// SPDX-License-Identifier: GPL-2.0-only
+// Copyright (C) 2022, Input Labs Oy.
+
+// Main loop scheduler.
+// Ticks are fired by a hardware alarm at absolute deadlines on a fixed grid,
+// so the phase never drifts. When a tick overruns past one or more
+// deadlines, the missed deadlines are skipped and the next tick starts
+// immediately on the latest grid point, never in a burst.
+//
+// With CFG_TICK_SOF_SYNC the grid is phase-locked to the USB start-of-frame,
+// so each tick starts CFG_TICK_SOF_LEAD before a frame edge and the report
+// is ready when the host polls. The edge is found by watching the frame
+// number register in a short window around the predicted edge after each
+// tick, and the grid is re-anchored on it, which also absorbs the drift
+// between the host and the local crystal.
+//
+// After CFG_IDLE_TIMEOUT without input activity the scheduler goes idle: the
+// core sleeps between slow heartbeat ticks, which still poll the inputs
+// without an interrupt line (IO expander, thumbstick, touch). A GPIO edge on
+// the home button or the rotary wakes it at once, and any activity resumes
+// the full rate on a new grid starting immediately. Inputs without an
+// interrupt line see up to a heartbeat of extra latency on the first press,
+// so idle is opt-in.
+
+#include <stdio.h>
+#include <pico/stdlib.h>
+#include <hardware/timer.h>
+#include <hardware/sync.h>
+#include <hardware/gpio.h>
+#include <hardware/structs/usb.h>
+#include <tusb.h>
+#include "config.h"
+#include "tick.h"
+#include "hid.h"
+#include "sampler.h"
+#include "helper.h"
+#include "pin.h"
+
+#if CFG_TICK_SOF_SYNC && ( \
+    (1000000 / CFG_TICK_FREQUENCY_0) % 1000 || \
+    (1000000 / CFG_TICK_FREQUENCY_1) % 1000 || \
+    (1000000 / CFG_TICK_FREQUENCY_2) % 1000 \
+)
+    #error "CFG_TICK_SOF_SYNC requires a tick interval multiple of 1ms"
+#endif
+
+uint tick_alarm;
+volatile bool tick_fired = false;
+uint16_t tick_frequency = 0;
+uint32_t tick_interval = 0;
+uint64_t tick_deadline = 0;
+uint64_t tick_start = 0;
+uint32_t tick_count = 0;
+tick_stats_t tick_stats = {0,};
+bool tick_sof_locked = false;
+bool tick_idle = false;
+volatile bool tick_woken = false;
+uint64_t tick_activity_time = 0;
+
+void tick_alarm_callback(uint alarm) {
+    tick_fired = true;
+    __sev();
+}
+
+// Input activity, keeps the scheduler out of idle.
+void tick_activity() {
+    tick_activity_time = time_us_64();
+}
+
+// Wake up from idle, safe to call from interrupts.
+void tick_wake() {
+    tick_woken = true;
+    __sev();
+}
+
+// Sleep until the given time, or until woken while idle.
+void tick_sleep_until(uint64_t time) {
+    tick_fired = false;
+    bool missed = hardware_alarm_set_target(tick_alarm, from_us_since_boot(time));
+    if (!missed) {
+        while (!tick_fired && !(tick_idle && tick_woken)) {
+            __wfe();
+            // Let completed report transfers chain the next pending one.
+            if (hid_is_pending()) tud_task();
+        }
+    }
+}
+
+bool tick_idle_expired() {
+    #if CFG_IDLE_TIMEOUT
+        return time_us_64() - tick_activity_time >= CFG_IDLE_TIMEOUT * 1000000ULL;
+    #else
+        return false;
+    #endif
+}
+
+void tick_wait_active() {
+    #if CFG_TICK_SOF_SYNC
+        tick_sof_sync();
+    #endif
+    tick_deadline += tick_interval;
+    uint64_t now = time_us_64();
+    if (now >= tick_deadline) {
+        // Overrun, previous tick finished after this deadline.
+        uint32_t missed = (now - tick_deadline) / tick_interval;
+        tick_deadline += (uint64_t)missed * tick_interval;
+        tick_stats.skipped += missed;
+        tick_stats.overruns += 1;
+    } else {
+        tick_sleep_until(tick_deadline);
+    }
+}
+
+void tick_wait_idle() {
+    tick_deadline += CFG_IDLE_HEARTBEAT * 1000;
+    if (time_us_64() < tick_deadline) tick_sleep_until(tick_deadline);
+    if (tick_woken) {
+        // Woken by an input interrupt, resume the full rate from now.
+        tick_woken = false;
+        tick_idle = false;
+        tick_activity();
+        tick_deadline = time_us_64();
+        tick_stats.idle_wakes += 1;
+    }
+}
+
+// Busy wait for the next change of the USB frame number, returns the time
+// of the edge or 0 on timeout.
+uint64_t tick_sof_capture(uint64_t timeout) {
+    uint32_t frame = usb_hw->sof_rd;
+    while (usb_hw->sof_rd == frame) {
+        if (time_us_64() >= timeout) return 0;
+        tight_loop_contents();
+    }
+    return time_us_64();
+}
+
+void tick_sof_sync() {
+    if (!tud_ready() || tud_suspended()) {
+        tick_sof_locked = false;
+        return;
+    }
+    uint64_t edge;
+    uint64_t now = time_us_64();
+    if (tick_sof_locked) {
+        uint64_t expected = tick_deadline + CFG_TICK_SOF_LEAD;
+        if (now + CFG_TICK_SOF_GUARD > expected) {
+            // Tick computed past the frame edge, the report missed it.
+            tick_stats.sof_late += 1;
+            return;
+        }
+        tick_sleep_until(expected - CFG_TICK_SOF_GUARD);
+        edge = tick_sof_capture(expected + CFG_TICK_SOF_GUARD);
+        if (!edge) {
+            tick_sof_locked = false;
+            tick_stats.sof_lost += 1;
+            return;
+        }
+        // Age of the sensor data when the report becomes available to the
+        // host poll on this frame.
+        uint32_t sampled = sampler_is_running() ?
+            sampler_get()->timestamp :
+            (uint32_t)tick_start;
+        uint32_t age = (uint32_t)edge - sampled;
+        tick_stats.sof_frames += 1;
+        tick_stats.sof_age_sum += age;
+        tick_stats.sof_age_max = max(tick_stats.sof_age_max, age);
+    } else {
+        // Search for any edge, frames are 1ms long.
+        edge = tick_sof_capture(now + 1000 + CFG_TICK_SOF_GUARD);
+        if (!edge) return;
+        tick_sof_locked = true;
+        tick_stats.sof_locks += 1;
+    }
+    tick_deadline = edge - CFG_TICK_SOF_LEAD;
+}
+
+void tick_wait() {
+    // Wake requests raised during the previous tick.
+    bool woken = tick_woken;
+    tick_woken = false;
+    if (tick_idle && (woken || !tick_idle_expired())) {
+        // Activity seen, resume the full rate at once on a new grid.
+        if (woken) tick_stats.idle_wakes += 1;
+        tick_idle = false;
+        tick_activity();
+        tick_deadline = time_us_64();
+    } else {
+        if (!tick_idle && tick_idle_expired()) {
+            tick_idle = true;
+            tick_sof_locked = false;
+            tick_stats.idle_entries += 1;
+        }
+        if (tick_idle) tick_wait_idle();
+        else tick_wait_active();
+    }
+    tick_start = time_us_64();
+    uint32_t jitter = tick_start - tick_deadline;
+    tick_stats.jitter_sum += jitter;
+    tick_stats.jitter_max = max(tick_stats.jitter_max, jitter);
+}
+
+void tick_completed() {
+    uint32_t compute = time_us_64() - tick_start;
+    tick_stats.compute_sum += compute;
+    tick_stats.compute_max = max(tick_stats.compute_max, compute);
+    tick_stats.ticks += 1;
+    tick_count += 1;
+}
+
+uint16_t tick_get_frequency() {
+    return tick_frequency;
+}
+
+void tick_update_frequency() {
+    tick_frequency = config_get_tick_frequency();
+    tick_interval = 1000000 / tick_frequency;
+    printf("Tick: frequency=%iHz\n", tick_frequency);
+}
+
+uint32_t tick_get_count() {
+    return tick_count;
+}
+
+tick_stats_t* tick_get_stats() {
+    return &tick_stats;
+}
+
+void tick_print_stats() {
+    uint32_t ticks = max(tick_stats.ticks, 1);
+    printf("Tick: interval=%luus ticks=%lu\n", tick_interval, tick_stats.ticks);
+    printf("  overruns=%lu skipped=%lu\n", tick_stats.overruns, tick_stats.skipped);
+    printf(
+        "  jitter avg=%lluus max=%luus\n",
+        tick_stats.jitter_sum / ticks,
+        tick_stats.jitter_max
+    );
+    printf(
+        "  compute avg=%lluus max=%luus\n",
+        tick_stats.compute_sum / ticks,
+        tick_stats.compute_max
+    );
+    printf(
+        "  idle=%u entries=%lu irq_wakes=%lu\n",
+        tick_idle,
+        tick_stats.idle_entries,
+        tick_stats.idle_wakes
+    );
+    #if CFG_TICK_SOF_SYNC
+        uint32_t frames = max(tick_stats.sof_frames, 1);
+        printf(
+            "  sof locked=%u locks=%lu lost=%lu late=%lu\n",
+            tick_sof_locked,
+            tick_stats.sof_locks,
+            tick_stats.sof_lost,
+            tick_stats.sof_late
+        );
+        printf(
+            "  sample-to-sof age avg=%lluus max=%luus\n",
+            tick_stats.sof_age_sum / frames,
+            tick_stats.sof_age_max
+        );
+    #endif
+}
+
+void tick_reset_stats() {
+    tick_stats = (tick_stats_t){0,};
+}
+
+void tick_init() {
+    printf("INIT: Tick scheduler\n");
+    tick_alarm = hardware_alarm_claim_unused(true);
+    hardware_alarm_set_callback(tick_alarm, tick_alarm_callback);
+    tick_update_frequency();
+    tick_deadline = time_us_64();
+    tick_activity_time = tick_deadline;
+    #if CFG_IDLE_TIMEOUT
+        // The GPIO callback is shared with the rotary, see rotary_callback.
+        gpio_set_irq_enabled(PIN_HOME, GPIO_IRQ_EDGE_FALL | GPIO_IRQ_EDGE_RISE, true);
+    #endif
+}
@@ -8,12 +8,16 @@
 #include "touch.h"
 #include "pin.h"
 #include "helper.h"
+#include "sampler.h"
 
 uint8_t loglevel = 0;
 uint8_t sens_from_config = 0;
 uint8_t dynamic_min = 0;
 uint8_t timeout = 0;
 float threshold = 0;
+uint8_t smooth = CFG_TOUCH_SMOOTH;
+uint16_t pushdown_freq = CFG_TOUCH_DYNAMIC_PUSHDOWN_FREQ;
+uint16_t debug_freq = DEBUG_TOUCH_ELAPSED_FREQ;
 
 void touch_update_threshold() {
     config_nvm_t config;
@@ -44,6 +48,11 @@ void touch_update_threshold() {
         timeout = CFG_GEN1_TOUCH_TIMEOUT;
         dynamic_min = CFG_GEN1_TOUCH_DYNAMIC_MIN;
     }
+    // Values in ticks keep the same duration at any tick frequency.
+    float tick_ratio = (float)config_get_tick_frequency() / CFG_TICK_FREQUENCY_BASE;
+    smooth = CFG_TOUCH_SMOOTH * tick_ratio;
+    pushdown_freq = CFG_TOUCH_DYNAMIC_PUSHDOWN_FREQ * tick_ratio;
+    debug_freq = DEBUG_TOUCH_ELAPSED_FREQ * tick_ratio;
 }
 
 void touch_init() {
@@ -77,12 +86,13 @@ float touch_get_dynamic_threshold(uint8_t elapsed) {
     static float peak = 0;
     static uint8_t elapsed_prev = 0;
     static uint16_t ticks = 0;
-    ticks++;
+    // Wrapped at the period, the counter overflow would shorten one cycle.
+    ticks = (ticks + 1) % pushdown_freq;
     // Push down:
     // A periodic but slow decrease of the peak, to avoid ever-growing peaks
     // in long gaming sessions. The hyperbolic function makes it so the
     // decrease is faster the more it deviates from the minimum.
-    if (!(ticks % CFG_TOUCH_DYNAMIC_PUSHDOWN_FREQ)) {
+    if (!ticks) {
         float x = dynamic_min / peak;
         float factor = tanhf(x * CFG_TOUCH_DYNAMIC_PUSHDOWN_HYPERBOLIC);
         peak = max(dynamic_min, peak * factor);
@@ -99,7 +109,11 @@ float touch_get_dynamic_threshold(uint8_t elapsed) {
 }
 
 bool touch_status() {
-    uint32_t elapsed = touch_get_elapsed();
+    uint32_t elapsed = (
+        sampler_is_running() ?
+        sampler_get()->touch_elapsed :
+        touch_get_elapsed()
+    );
     // Determine threshold.
     if (elapsed != 0) {
         threshold = (
@@ -113,8 +127,8 @@ bool touch_status() {
     // Debug.
     if (loglevel >= 2) {
         static uint16_t x = 0;
-        x++;
-        if (!(x % DEBUG_TOUCH_ELAPSED_FREQ)) {
+        x = (x + 1) % debug_freq;
+        if (!x) {
             printf("%i %.2f\n", elapsed, threshold);
         }
     }
@@ -125,7 +139,7 @@ bool touch_status() {
     if (over != touched) {
         // Only report change on repeated hits.
         hits++;
-        if (hits >= CFG_TOUCH_SMOOTH) {
+        if (hits >= smooth) {
             touched = over;
             if (loglevel >= 1) printf("Touch status %i\n", touched);
         }
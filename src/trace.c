@@ -0,0 +1,111 @@
+// SPDX-License-Identifier: GPL-2.0-only
+// Copyright (C) 2022, Input Labs Oy.
+
+// End-to-end input latency tracer.
+// A raw edge of a physical button is timestamped when its input is sampled.
+// Presses and releases emitted while that button is being reported mark the
+// edge as pending on their HID class, and the latency is recorded when the
+// report of that class is handed to the USB stack. Actions emitted later by
+// time-based behaviors (holds, macros) are not traced, as their delay is
+// intentional. Time from the report call to the host poll is not included.
+
+#include <stdio.h>
+#include <pico/time.h>
+#include "config.h"
+#include "trace.h"
+#include "hid.h"
+#include "helper.h"
+
+static const char *class_names[TRACE_CLASSES] = {
+    "keyboard",
+    "mouse",
+    "gamepad",
+};
+
+uint32_t trace_edge_timestamp = 0;
+uint32_t trace_pending[TRACE_CLASSES] = {0,};
+uint16_t trace_samples[TRACE_CLASSES][TRACE_SAMPLES];
+uint32_t trace_count[TRACE_CLASSES] = {0,};
+
+// Called with the raw state of a physical button every time it is read.
+void trace_edge(bool *state, bool pressed, uint32_t timestamp) {
+    if (!CFG_LATENCY_TRACE) return;
+    if (pressed == *state) return;
+    *state = pressed;
+    trace_edge_timestamp = max(timestamp, 1);
+}
+
+// Called once the button that produced the edge has been reported.
+void trace_edge_clear() {
+    trace_edge_timestamp = 0;
+}
+
+void trace_key(uint8_t key) {
+    if (!CFG_LATENCY_TRACE) return;
+    if (!trace_edge_timestamp) return;
+    TraceClass class = (
+        key >= GAMEPAD_INDEX ? TRACE_GAMEPAD :
+        key >= MOUSE_INDEX ? TRACE_MOUSE :
+        TRACE_KEYBOARD
+    );
+    // Keep the oldest edge when several are waiting for the same report.
+    if (!trace_pending[class]) trace_pending[class] = trace_edge_timestamp;
+}
+
+void trace_commit(TraceClass class) {
+    if (!CFG_LATENCY_TRACE) return;
+    if (!trace_pending[class]) return;
+    uint32_t latency = time_us_32() - trace_pending[class];
+    uint32_t index = trace_count[class] & (TRACE_SAMPLES - 1);
+    trace_samples[class][index] = min(latency, UINT16_MAX);
+    trace_count[class] += 1;
+    trace_pending[class] = 0;
+}
+
+// The report turned out identical to the last one and was not sent.
+void trace_discard(TraceClass class) {
+    trace_pending[class] = 0;
+}
+
+void trace_sort(uint16_t *values, uint16_t len) {
+    for(uint16_t i=1; i<len; i++) {
+        uint16_t value = values[i];
+        int16_t j = i - 1;
+        while (j >= 0 && values[j] > value) {
+            values[j + 1] = values[j];
+            j--;
+        }
+        values[j + 1] = value;
+    }
+}
+
+void trace_print() {
+    if (!CFG_LATENCY_TRACE) {
+        printf("Trace: disabled, see CFG_LATENCY_TRACE\n");
+        return;
+    }
+    printf("Trace: edge-to-report latency in us (last %i per class)\n", TRACE_SAMPLES);
+    for(uint8_t i=0; i<TRACE_CLASSES; i++) {
+        uint16_t len = min(trace_count[i], TRACE_SAMPLES);
+        if (len == 0) continue;
+        uint16_t sorted[TRACE_SAMPLES];
+        for(uint16_t j=0; j<len; j++) sorted[j] = trace_samples[i][j];
+        trace_sort(sorted, len);
+        printf(
+            "  %-8s n=%lu p50=%u p90=%u p99=%u max=%u\n",
+            class_names[i],
+            trace_count[i],
+            sorted[len * 50 / 100],
+            sorted[len * 90 / 100],
+            sorted[len * 99 / 100],
+            sorted[len - 1]
+        );
+    }
+}
+
+void trace_reset() {
+    for(uint8_t i=0; i<TRACE_CLASSES; i++) {
+        trace_count[i] = 0;
+        trace_pending[i] = 0;
+    }
+}
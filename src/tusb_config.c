@@ -4,6 +4,7 @@
 #include <tusb_config.h>
 #include <tusb.h>
 #include "config.h"
+#include "hid.h"
 
 static const char *const descriptor_string[] = {
     (const char[]){0x09, 0x04},
@@ -14,28 +15,105 @@ static const char *const descriptor_string[] = {
     STRING_INTERFACE_1,
 };
 
+#if CFG_HID_KEYBOARD_NKRO
+    #define DESCRIPTOR_REPORT_KEYBOARD(...) \
+        TUD_HID_REPORT_DESC_KEYBOARD_NKRO(__VA_ARGS__)
+#else
+    #define DESCRIPTOR_REPORT_KEYBOARD(...) \
+        TUD_HID_REPORT_DESC_KEYBOARD(__VA_ARGS__)
+#endif
+
+#if CFG_HID_MOUSE_16BIT
+    #define DESCRIPTOR_REPORT_MOUSE(...) \
+        TUD_HID_REPORT_DESC_MOUSE_16BIT(__VA_ARGS__)
+#else
+    #define DESCRIPTOR_REPORT_MOUSE(...) \
+        TUD_HID_REPORT_DESC_MOUSE(__VA_ARGS__)
+#endif
+
+#if CFG_HID_GAMEPAD_16BIT
+    #define DESCRIPTOR_REPORT_GAMEPAD(...) \
+        TUD_HID_REPORT_DESC_GAMEPAD_16BIT(__VA_ARGS__)
+#else
+    #define DESCRIPTOR_REPORT_GAMEPAD(...) \
+        TUD_HID_REPORT_DESC_GAMEPAD(__VA_ARGS__)
+#endif
+
+#if CFG_HID_SEPARATE_INTERFACES
+
+// One interface per class, so each has its own endpoint and they can all be
+// sent in the same frame. Reports carry no report ID.
+uint8_t const descriptor_report_keyboard[] = {DESCRIPTOR_REPORT_KEYBOARD()};
+uint8_t const descriptor_report_mouse[] = {DESCRIPTOR_REPORT_MOUSE()};
+uint8_t const descriptor_report_gamepad[] = {DESCRIPTOR_REPORT_GAMEPAD()};
+
+#define DESCRIPTOR_INTERFACES_HID_KEYBOARD_MOUSE \
+    DESCRIPTOR_INTERFACE_HID( \
+        ITF_KEYBOARD, \
+        HID_ITF_PROTOCOL_KEYBOARD, \
+        sizeof(descriptor_report_keyboard), \
+        EP_HID_KEYBOARD \
+    ), \
+    DESCRIPTOR_INTERFACE_HID( \
+        ITF_MOUSE, \
+        HID_ITF_PROTOCOL_NONE, \
+        sizeof(descriptor_report_mouse), \
+        EP_HID_MOUSE \
+    )
+
+uint8_t descriptor_configuration_generic[] = {
+    DESCRIPTOR_CONFIGURATION(0x03),
+    DESCRIPTOR_INTERFACES_HID_KEYBOARD_MOUSE,
+    DESCRIPTOR_INTERFACE_HID(
+        ITF_GAMEPAD,
+        HID_ITF_PROTOCOL_NONE,
+        sizeof(descriptor_report_gamepad),
+        EP_HID_GAMEPAD
+    )
+};
+
+uint8_t descriptor_configuration_xinput[] = {
+    DESCRIPTOR_CONFIGURATION(0x03),
+    DESCRIPTOR_INTERFACES_HID_KEYBOARD_MOUSE,
+    DESCRIPTOR_INTERFACE_XINPUT
+};
+
+#else
+
 uint8_t const descriptor_report_generic[] = {
-    TUD_HID_REPORT_DESC_KEYBOARD(HID_REPORT_ID(REPORT_KEYBOARD)),
-    TUD_HID_REPORT_DESC_MOUSE(HID_REPORT_ID(REPORT_MOUSE)),
-    TUD_HID_REPORT_DESC_GAMEPAD(HID_REPORT_ID(REPORT_GAMEPAD)),
+    DESCRIPTOR_REPORT_KEYBOARD(HID_REPORT_ID(REPORT_KEYBOARD)),
+    DESCRIPTOR_REPORT_MOUSE(HID_REPORT_ID(REPORT_MOUSE)),
+    DESCRIPTOR_REPORT_GAMEPAD(HID_REPORT_ID(REPORT_GAMEPAD)),
 };
 
 uint8_t const descriptor_report_xinput[] = {
-    TUD_HID_REPORT_DESC_KEYBOARD(HID_REPORT_ID(REPORT_KEYBOARD)),
-    TUD_HID_REPORT_DESC_MOUSE(HID_REPORT_ID(REPORT_MOUSE)),
+    DESCRIPTOR_REPORT_KEYBOARD(HID_REPORT_ID(REPORT_KEYBOARD)),
+    DESCRIPTOR_REPORT_MOUSE(HID_REPORT_ID(REPORT_MOUSE)),
 };
 
 uint8_t descriptor_configuration_generic[] = {
     DESCRIPTOR_CONFIGURATION(0x01),
-    DESCRIPTOR_INTERFACE_HID(sizeof(descriptor_report_generic))
+    DESCRIPTOR_INTERFACE_HID(
+        ITF_KEYBOARD,
+        HID_ITF_PROTOCOL_KEYBOARD,
+        sizeof(descriptor_report_generic),
+        EP_HID_KEYBOARD
+    )
 };
 
 uint8_t descriptor_configuration_xinput[] = {
     DESCRIPTOR_CONFIGURATION(0x02),
-    DESCRIPTOR_INTERFACE_HID(sizeof(descriptor_report_xinput)),
+    DESCRIPTOR_INTERFACE_HID(
+        ITF_KEYBOARD,
+        HID_ITF_PROTOCOL_KEYBOARD,
+        sizeof(descriptor_report_xinput),
+        EP_HID_KEYBOARD
+    ),
     DESCRIPTOR_INTERFACE_XINPUT
 };
 
+#endif
+
 uint8_t const *tud_descriptor_device_cb() {
     printf("USB: tud_descriptor_device_cb\n");
     static tusb_desc_device_t descriptor_device = {DESCRIPTOR_DEVICE};
@@ -63,9 +141,15 @@ uint8_t const *tud_descriptor_configuration_cb(uint8_t index) {
 }
 
 uint8_t const *tud_hid_descriptor_report_cb(uint8_t instance) {
-    printf("USB: tud_hid_descriptor_report_cb\n");
-    if (config_get_os_mode() == OS_MODE_GENERIC) return descriptor_report_generic;
-    else return descriptor_report_xinput;
+    printf("USB: tud_hid_descriptor_report_cb instance=%i\n", instance);
+    #if CFG_HID_SEPARATE_INTERFACES
+        if (instance == ITF_MOUSE) return descriptor_report_mouse;
+        if (instance == ITF_GAMEPAD) return descriptor_report_gamepad;
+        return descriptor_report_keyboard;
+    #else
+        if (config_get_os_mode() == OS_MODE_GENERIC) return descriptor_report_generic;
+        else return descriptor_report_xinput;
+    #endif
 }
 
 const uint16_t *tud_descriptor_string_cb(uint8_t index, uint16_t langid) {
@@ -110,6 +194,11 @@ const bool tud_vendor_control_xfer_cb(
     return true;
 }
 
+void tud_mount_cb() {
+    // Hosts that support high-resolution scrolling enable it after mounting.
+    hid_set_wheel_hires(false);
+}
+
 uint16_t tud_hid_get_report_cb(
     uint8_t instance,
     uint8_t report_id,
@@ -117,7 +206,8 @@ uint16_t tud_hid_get_report_cb(
     uint8_t* buffer,
     uint16_t reqlen
 ) {
-    return 0;
+    if (report_type != HID_REPORT_TYPE_FEATURE) return 0;
+    return hid_get_feature(instance, report_id, buffer, reqlen);
 }
 
 void tud_hid_set_report_cb(
@@ -126,4 +216,20 @@ void tud_hid_set_report_cb(
     hid_report_type_t report_type,
     uint8_t const* buffer,
     uint16_t bufsize
-) {}
+) {
+    if (report_type != HID_REPORT_TYPE_FEATURE) return;
+    hid_set_feature(instance, report_id, buffer, bufsize);
+}
+
+void tud_hid_set_protocol_cb(uint8_t instance, uint8_t protocol) {
+    printf("USB: tud_hid_set_protocol_cb protocol=%i\n", protocol);
+    hid_resync();
+}
+
+void tud_hid_report_complete_cb(
+    uint8_t instance,
+    uint8_t const* report,
+    uint8_t len
+) {
+    hid_report_drain();
+}
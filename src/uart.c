@@ -6,7 +6,13 @@
 #include <pico/bootrom.h>
 #include <hardware/watchdog.h>
 #include "config.h"
+#include "calibration.h"
 #include "self_test.h"
+#include "tick.h"
+#include "hid.h"
+#include "event.h"
+#include "profiler.h"
+#include "trace.h"
 
 void uart_listen_char_do(bool limited) {
     char input = getchar_timeout_us(0);
@@ -25,7 +31,7 @@ void uart_listen_char_do(bool limited) {
 
     if (input == 'C') {
         printf("UART: Calibrate\n");
-        config_calibrate();
+        calibration_start();
     }
     if (input == 'F') {
         printf("UART: Format NVM\n");
@@ -36,6 +42,24 @@ void uart_listen_char_do(bool limited) {
         printf("UART: Self-test\n");
         self_test();
     }
+    if (input == 'S') {
+        printf("UART: Tick stats\n");
+        tick_print_stats();
+        tick_reset_stats();
+        hid_print_stats();
+        hid_reset_stats();
+        event_print_stats();
+    }
+    if (input == 'P') {
+        printf("UART: Profiler\n");
+        profiler_print();
+        profiler_reset();
+    }
+    if (input == 'L') {
+        printf("UART: Latency trace\n");
+        trace_print();
+        trace_reset();
+    }
 }
 
 void uart_listen_char() {
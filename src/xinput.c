@@ -4,14 +4,31 @@
 #include <tusb.h>
 #include <device/usbd_pvt.h>
 #include "xinput.h"
+#include "rumble.h"
+#include "hid.h"
 #include "tusb_config.h"
 
 const uint8_t ep_in[] = {DESCRIPTOR_ENDPOINT_XINPUT_IN};
 const uint8_t ep_out[] = {DESCRIPTOR_ENDPOINT_XINPUT_OUT};
 
+// Packets from the host are received asynchronously, the OUT transfer is
+// re-armed on completion so the endpoint is always listening and the IN
+// report path is never waited on.
+uint8_t xinput_out_buffer[XINPUT_OUT_SIZE];
+uint8_t xinput_led = 0;
+
+// Reports are built in place in one buffer while the other may still be in
+// flight, a buffer is released when its transfer completes.
+xinput_report xinput_buffers[2];
+uint8_t xinput_buffer_index = 0;
+uint8_t xinput_buffers_busy = 0;  // Bitmask.
+
 static void xinput_init(void) {}
 
-static void xinput_reset(uint8_t rhport) {}
+static void xinput_reset(uint8_t rhport) {
+    xinput_buffers_busy = 0;
+    rumble_set(0, 0);
+}
 
 static uint16_t xinput_open(
     uint8_t rhport,
@@ -27,6 +44,7 @@ static uint16_t xinput_open(
     if (itf_desc->iInterface == 0) {
         usbd_edpt_open(rhport, (tusb_desc_endpoint_t const *)ep_in);
         usbd_edpt_open(rhport, (tusb_desc_endpoint_t const *)ep_out);
+        xinput_receive_report();
         return (
             sizeof(tusb_desc_interface_t) +
             16 +
@@ -45,13 +63,36 @@ static bool xinput_control_xfer_cb(
     return true;
 }
 
+// Rumble: 0x00 0x08 0x00 <left> <right> 0x00 0x00 0x00.
+// LED: 0x01 0x03 <pattern>.
+void xinput_parse(uint8_t *buffer, uint32_t len) {
+    if (len < 3 || buffer[1] > len) return;
+    if (buffer[0] == XINPUT_OUT_RUMBLE && buffer[1] >= 5) {
+        rumble_set(buffer[3], buffer[4]);
+    }
+    if (buffer[0] == XINPUT_OUT_LED && buffer[2] != xinput_led) {
+        xinput_led = buffer[2];
+        printf("XInput: LED pattern %i\n", xinput_led);
+    }
+}
+
 static bool xinput_xfer_cb(
     uint8_t rhport,
     uint8_t ep_addr,
     xfer_result_t result,
     uint32_t xferred_bytes
 ) {
-    // printf("xinput_xfer_cb\n");
+    if (ep_addr == ((tusb_desc_endpoint_t *)ep_out)->bEndpointAddress) {
+        if (result == XFER_RESULT_SUCCESS) {
+            xinput_parse(xinput_out_buffer, xferred_bytes);
+        }
+        xinput_receive_report();
+    }
+    if (ep_addr == ((tusb_desc_endpoint_t *)ep_in)->bEndpointAddress) {
+        xinput_buffers_busy &= ~(1 << !xinput_buffer_index);
+        // Anything that could not be sent meanwhile goes in the freed slot.
+        hid_report_drain();
+    }
     return true;
 }
 
@@ -69,30 +110,36 @@ usbd_class_driver_t const *usbd_app_driver_get_cb(uint8_t *driver_count) {
     return &xinput_driver;
 }
 
-void xinput_send_report(xinput_report *report) {
+// Buffer to build the next report into.
+xinput_report *xinput_report_buffer() {
+    return &xinput_buffers[xinput_buffer_index];
+}
+
+// Send the report in the current buffer, returns false if the endpoint is
+// busy, the buffer is then kept and can be rebuilt for the next attempt.
+bool xinput_send_report() {
     uint8_t addr = ((tusb_desc_endpoint_t *)ep_in)->bEndpointAddress;
-    if (!usbd_edpt_busy(0, addr)) {
-        usbd_edpt_claim(0, addr);
-        usbd_edpt_xfer(0, addr, (uint8_t*)report, XINPUT_REPORT_SIZE);
-        usbd_edpt_release(0, addr);
-    }
+    if (xinput_buffers_busy & (1 << xinput_buffer_index)) return false;
+    if (usbd_edpt_busy(0, addr)) return false;
+    usbd_edpt_claim(0, addr);
+    bool sent = usbd_edpt_xfer(
+        0,
+        addr,
+        (uint8_t*)xinput_report_buffer(),
+        XINPUT_REPORT_SIZE
+    );
+    usbd_edpt_release(0, addr);
+    if (!sent) return false;
+    xinput_buffers_busy |= 1 << xinput_buffer_index;
+    xinput_buffer_index ^= 1;
+    return true;
 }
 
-// void xinput_receive_report() {
-//     uint8_t addr = ((tusb_desc_endpoint_t *)ep_out)->bEndpointAddress;
-//     uint8_t buffer[8] = {0, 0, 0, 0, 0, 0, 0, 0};
-//     usbd_edpt_claim(0, addr);
-//     usbd_edpt_xfer(0, addr, buffer, 8);
-//     usbd_edpt_release(0, addr);
-//     printf(
-//         "BUF %i %i %i %i %i %i %i %i\n",
-//         buffer[0],
-//         buffer[1],
-//         buffer[2],
-//         buffer[3],
-//         buffer[4],
-//         buffer[5],
-//         buffer[6],
-//         buffer[7]
-//     );
-// }
+bool xinput_receive_report() {
+    uint8_t addr = ((tusb_desc_endpoint_t *)ep_out)->bEndpointAddress;
+    if (usbd_edpt_busy(0, addr)) return false;
+    usbd_edpt_claim(0, addr);
+    usbd_edpt_xfer(0, addr, xinput_out_buffer, XINPUT_OUT_SIZE);
+    usbd_edpt_release(0, addr);
+    return true;
+}